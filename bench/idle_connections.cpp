@@ -0,0 +1,211 @@
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+measures the memory a running webserv needs per idle connection:
+    - opens the given number of connections and keeps them open, with a path every connection
+      first gets one keep-alive GET answered, so it is idle after a request like in real use
+    - the RSS of the server (VmRSS of /proc/<pid>/status) before and after, divided by the
+      number of connections, is the cost of an idle connection
+    - to a loopback address the connections come from 127.0.0.2 on, CONNECTIONS_PER_SOURCE per
+      source address, so the ephemeral ports of one address do not limit the number
+    - the open files limit of this process and of the server have to allow the connections
+*/
+
+#define CONNECTIONS_PER_SOURCE                      25000
+#define SETTLE_TIMEOUT                              30
+
+// ================   Utils   ================ //
+/*
+returns the VmRSS of the process in kB, -1 if it can not be read
+*/
+static long readRss(pid_t pid)
+{
+    std::ostringstream  path;
+    std::string         line;
+
+    path << "/proc/" << pid << "/status";
+    std::ifstream status(path.str().c_str());
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return atol(line.c_str() + 6);
+    }
+    return -1;
+}
+
+/*
+returns the number of open fds of the process, -1 if they can not be listed
+*/
+static long countFds(pid_t pid)
+{
+    std::ostringstream  path;
+    DIR                 *dir;
+    long                count = 0;
+
+    path << "/proc/" << pid << "/fd";
+    if ((dir = opendir(path.str().c_str())) == NULL)
+        return -1;
+    while (readdir(dir) != NULL)
+        count++;
+    closedir(dir);
+    return count - 2;
+}
+
+/*
+reads one response: the header section and as many bytes of body as Content-Length says
+*/
+static bool readResponse(int fd)
+{
+    std::string response;
+    char        buffer[65536];
+    size_t      end;
+    ssize_t     bytes;
+
+    while ((end = response.find("\r\n\r\n")) == std::string::npos)
+    {
+        if ((bytes = read(fd, buffer, sizeof(buffer))) <= 0)
+            return false;
+        response.append(buffer, bytes);
+    }
+
+    size_t  length = 0;
+    size_t  pos = response.find("Content-Length:");
+
+    if (pos != std::string::npos && pos < end)
+        length = strtoul(response.c_str() + pos + 15, NULL, 10);
+    while (response.size() < end + 4 + length)
+    {
+        if ((bytes = read(fd, buffer, sizeof(buffer))) <= 0)
+            return false;
+        response.append(buffer, bytes);
+    }
+    return true;
+}
+
+/*
+opens one connection to address, from the source address (if not 0), with one request for path (if not empty)
+    - returns the fd of the connection, -1 on error
+*/
+static int openConnection(const sockaddr_in &address, in_addr_t source, const std::string &request)
+{
+    int         fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in local;
+
+    if (fd < 0)
+        return -1;
+    if (source != 0)
+    {
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = source;
+        if (bind(fd, (sockaddr *)&local, sizeof(local)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    if (connect(fd, (const sockaddr *)&address, sizeof(address)) != 0
+        || (!request.empty() && (write(fd, request.data(), request.size()) != (ssize_t)request.size() || !readResponse(fd))))
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3 || argc > 6)
+    {
+        std::cerr << "Usage: " << argv[0] << " <server pid> <connections> [host] [port] [path]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    pid_t               pid = atoi(argv[1]);
+    long                connections = atol(argv[2]);
+    std::string         host = argc > 3 ? argv[3] : "127.0.0.1";
+    int                 port = argc > 4 ? atoi(argv[4]) : 8080;
+    std::string         request;
+    sockaddr_in         address;
+    struct rlimit       limit;
+    std::vector<int>    fds;
+
+    if (argc > 5)
+        request = std::string("GET ") + argv[5] + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: keep-alive\r\n\r\n";
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (connections <= 0 || inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1)
+    {
+        std::cerr << "Invalid number of connections or host" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // raises the limit of open files, it has to allow all connections
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur < (rlim_t)connections + 16)
+    {
+        std::cerr << "The limit of open files (" << limit.rlim_cur << ") is too low for " << connections << " connections, raise it (ulimit -n)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    long    rss_before = readRss(pid);
+    long    fds_before = countFds(pid);
+    bool    loopback = (ntohl(address.sin_addr.s_addr) >> 24) == 127;
+
+    if (rss_before < 0 || fds_before < 0)
+    {
+        std::cerr << "Could not read /proc/" << pid << " (no such server or no permission)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // opens the connections
+    fds.reserve(connections);
+    for (long i = 0; i < connections; i++)
+    {
+        in_addr_t   source = loopback ? htonl((127u << 24) + 2 + i / CONNECTIONS_PER_SOURCE) : 0;
+        int         fd = openConnection(address, source, request);
+
+        if (fd < 0)
+        {
+            std::cerr << "Connection " << i << " failed: " << strerror(errno) << std::endl;
+            break ;
+        }
+        fds.push_back(fd);
+    }
+
+    // waits until the server accepted all connections which got opened
+    for (int seconds = 0; seconds < SETTLE_TIMEOUT && countFds(pid) < fds_before + (long)fds.size(); seconds++)
+        sleep(1);
+    sleep(1);
+
+    long    rss_after = readRss(pid);
+    long    accepted = countFds(pid) - fds_before;
+
+    std::cout << "connections:               " << fds.size() << " (" << accepted << " open in the server)" << std::endl;
+    std::cout << "server rss before:         " << rss_before << " kB" << std::endl;
+    std::cout << "server rss after:          " << rss_after << " kB" << std::endl;
+    if (!fds.empty())
+        std::cout << "bytes per idle connection: " << (rss_after - rss_before) * 1024 / (long)fds.size() << std::endl;
+    for (size_t i = 0; i < fds.size(); i++)
+        close(fds[i]);
+    return fds.size() == (size_t)connections ? EXIT_SUCCESS : EXIT_FAILURE;
+}
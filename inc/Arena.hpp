@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <map>
+
+/*
+bump allocator for the data which lives exactly as long as one request of a connection:
+    - allocations move a pointer forward in the current block, nothing is freed on its own
+    - reset() rewinds the first block, which stays allocated (warm) for the next request,
+      only blocks needed by an unusually large request are given back
+*/
+class Arena
+{
+private:
+    struct Block
+    {
+        Block   *_next;
+        size_t  _size;
+    };
+
+    Block   *_first;
+    Block   *_current;
+    size_t  _used;
+
+// Private Member functions
+    Block   *_newBlock(size_t size);
+
+// Copy Constructor
+    Arena(const Arena &rhs);
+
+// Assignment Operator
+    Arena &operator=(const Arena &rhs);
+
+public:
+// Constructor
+    Arena();
+
+// Deconstructor
+    ~Arena();
+
+// Getters
+    size_t  getCapacity() const;
+
+// Member functions
+    void    *allocate(size_t size);
+    void    reset();
+    void    release();
+
+};
+
+/*
+STL allocator which takes the memory of a container out of an arena:
+    - deallocate() does nothing, the memory comes back with Arena::reset()
+    - the elements still need to be destroyed (clear()) before the arena is reset
+*/
+template <typename T>
+class ArenaAllocator
+{
+public:
+    typedef T               value_type;
+    typedef T*              pointer;
+    typedef const T*        const_pointer;
+    typedef T&              reference;
+    typedef const T&        const_reference;
+    typedef size_t          size_type;
+    typedef ptrdiff_t       difference_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef ArenaAllocator<U> other;
+    };
+
+    Arena   *_arena;
+
+// Constructor
+    ArenaAllocator(Arena *arena = NULL) : _arena(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &rhs) : _arena(rhs._arena) {}
+
+// Member functions
+    pointer         address(reference x) const { return &x; }
+    const_pointer   address(const_reference x) const { return &x; }
+    pointer         allocate(size_type n, const void * = 0) { return static_cast<pointer>(_arena->allocate(n * sizeof(T))); }
+    void            deallocate(pointer, size_type) {}
+    size_type       max_size() const { return size_t(-1) / sizeof(T); }
+    void            construct(pointer p, const T &value) { new (p) T(value); }
+    void            destroy(pointer p) { p->~T(); }
+
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &lhs, const ArenaAllocator<U> &rhs)
+{
+    return lhs._arena == rhs._arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &lhs, const ArenaAllocator<U> &rhs)
+{
+    return lhs._arena != rhs._arena;
+}
+
+// header fields of a response, kept in the arena of its connection
+typedef std::map<std::string, std::string, std::less<std::string>, ArenaAllocator<std::pair<const std::string, std::string> > > HeaderMap;
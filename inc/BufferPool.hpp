@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+/*
+pool of fixed-size I/O buffers, shared by all connections:
+    - IO_BUFFER_SIZE for the ordinary case, IO_LARGE_BUFFER_SIZE on demand
+    - the buffers are carved out of BUFFER_POOL_SLAB_SIZE mappings (hugepages if there are any)
+      and go onto a free list when they are given back, the memory is kept for the next connection
+*/
+class BufferPool
+{
+private:
+    struct FreeBuffer
+    {
+        FreeBuffer  *_next;
+    };
+
+    static FreeBuffer   *_free[2];
+    static char         *_slab;
+    static size_t       _slab_used;
+    static size_t       _reserved;
+    static size_t       _lent;
+
+// Private static member functions
+    static char *_carve(size_t size);
+
+public:
+// Static member functions
+    static char     *acquire(size_t &size);
+    static void     release(char *buffer, size_t size);
+    static size_t   getReserved();
+    static size_t   getLent();
+
+};
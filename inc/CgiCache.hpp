@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+struct CgiCacheEntry
+{
+    std::map<std::string, std::string>  _headers;
+    std::string                         _body;
+    time_t                              _stored;
+    time_t                              _expires;
+    time_t                              _stale_until;
+    bool                                _refreshing;
+};
+
+class CgiCache
+{
+private:
+    static std::map<std::string, CgiCacheEntry>    _entries;
+    static size_t                                   _size;
+
+// Private static member functions
+    static void _erase(std::map<std::string, CgiCacheEntry>::iterator it);
+    static void _purge(time_t now);
+
+public:
+// Static member functions
+    static std::string      buildKey(const Request &request, const Location &location);
+    static CgiCacheEntry*   lookup(const std::string &key, time_t now);
+    static void             store(const std::string &key, int status, const HeaderMap &headers, const std::string &body, const Location &location);
+
+};
@@ -20,32 +20,78 @@ private:
     int                                 _error;
     std::map<std::string, std::string>  _headers;
     std::string                         _body;
-    char**                              _env;
+    std::string                         _output;
+    std::string                         _env_block;
+    std::vector<char*>                  _env;
     std::string                         _binary_path;
     std::string                         _script_path;
     sockaddr_in                         _client_addr;
     Request&                            _request;
-    ServerBlock&                        _server;
+    const ServerBlock&                  _server;
+    const Location&                     _location;
+    pid_t                               _pid;
+    int                                 _pidfd;
+    int                                 _in_fd;
+    int                                 _out_fd;
+    size_t                              _in_offset;
+    int                                 _status;
+    time_t                              _deadline;
+    bool                                _exited;
+    bool                                _started;
+    bool                                _parsed;
+    bool                                _timed_out;
+    bool                                _fastcgi;
+    bool                                _fcgi_stdin_closed;
+    bool                                _fcgi_ended;
+    std::string                         _fcgi_out;
+    std::string                         _fcgi_in;
+    std::string                         _handoff;
+
+    static std::vector<pid_t>           _orphans;
 
 // Private Member functions
-    void    _readCgi(int fd);
     void    _parseCgi(std::string &output);
     bool    _addHeader(std::string &header_name, std::string &header_value);
+    void    _addEnv(const char *name, const std::string &value);
     void    _buildEnvironment();
+    void    _execFastCgi();
+    bool    _writeFastCgi();
+    bool    _readFastCgi();
+    bool    _acquireWorker();
+    void    _appendRecords(uint8_t type, const char *content, size_t len);
 
 public:
 // Constructor
-    CgiHandler(Request &request, ServerBlock &server, std::string script_path, std::string binary_path, sockaddr_in client_addr);
+    CgiHandler(Request &request, const ServerBlock &server, const Location &location, std::string script_path, std::string binary_path, sockaddr_in client_addr);
 
 // Deconstructor
     ~CgiHandler();
 
 // Getters
     int                                         getError() const;
+    int                                         getInputFd() const;
+    int                                         getOutputFd() const;
+    int                                         getPidFd() const;
     std::string                                 getBody() const;
     const std::map<std::string, std::string>&   getHeaders() const;
+    const Location&                             getLocation() const;
 
 // Member functions
     void    execCgi();
+    bool    writeInput();
+    bool    readOutput();
+    bool    reap();
+    bool    checkTimeout(time_t now);
+    void    restartTimeout();
+    bool    isStarted() const;
+    bool    parseHeaders();
+    bool    isFinished() const;
+    void    closeFd(int fd);
+    void    finish();
+
+// Static member functions
+    static pid_t    spawnProcess(char **argv, char **env, const Location *location, int &in_fd, int &out_fd, int stdin_fd = -1);
+    static void     addOrphan(pid_t pid);
+    static void     reapOrphans();
 
 };
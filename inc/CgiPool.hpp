@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+struct CgiWorker
+{
+    pid_t                               _pid;
+    int                                 _in_fd;
+    int                                 _out_fd;
+};
+
+struct CgiWorkerPool
+{
+    size_t                              _min;
+    size_t                              _max;
+    size_t                              _target;
+    time_t                              _last_resize;
+    std::vector<CgiWorker>              _idle;
+};
+
+class CgiPool
+{
+private:
+    static std::map<std::string, CgiWorkerPool>    _pools;
+
+// Private static member functions
+    static bool _spawnWorker(const std::string &binary, CgiWorkerPool &pool);
+    static void _retireWorker(CgiWorker &worker);
+
+public:
+// Static member functions
+    static void configure(const std::map<std::string, std::pair<size_t, size_t> > &pools);
+    static bool acquire(const std::string &binary, pid_t &pid, int &in_fd, int &out_fd);
+    static void maintain();
+
+};
@@ -4,12 +4,31 @@
 #include "Request.hpp"
 #include "Response.hpp"
 
+/*
+a connection, while it is idle it is only its fd, its socket, its deadline and the address of the peer:
+    - request and response are attached once data arrives and go back to the spares
+      of the ServerManager when the response is sent (see _attachState(), _detachState())
+*/
 struct Client
 {
     struct sockaddr_in  _client_address;
     int                 _client_fd;
     time_t              _last_msg_time;
-    Request             request;
-    Response            response;
     Socket              *socket;
+    Request             *request;
+    Response            *response;
+
+// Constructor
+    Client();
+
+// Copy Constructor
+    Client(const Client &rhs);
+
+// Deconstructor
+    ~Client();
+
+private:
+// not assignable, it owns request and response
+    Client &operator=(const Client &rhs);
+
 };
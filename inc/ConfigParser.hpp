@@ -10,6 +10,8 @@ enum Directive
     LISTEN,
     SERVER_NAME,
     CLIENT_MAX_BODY_SIZE,
+    CLIENT_BODY_BUFFER_SIZE,
+    CLIENT_BODY_TEMP_PATH,
     ERROR_PAGE,
     ALLOWED_METHODS,
     REDIRECTION,
@@ -17,7 +19,20 @@ enum Directive
     AUTOINDEX,
     INDEX,
     UPLOAD,
+    UPLOAD_FSYNC,
     CGI,
+    CGI_TIMEOUT,
+    CGI_POOL,
+    CGI_LIMIT_CPU,
+    CGI_LIMIT_AS,
+    CGI_LIMIT_NOFILE,
+    CGI_MAX_CONCURRENCY,
+    CGI_QUEUE,
+    CGI_CACHE,
+    CGI_CACHE_KEY_HEADERS,
+    CGI_COALESCE,
+    CGI_STREAM,
+    FASTCGI_PASS,
     LOCATION,
     UNKNOWN,
 };
@@ -40,6 +55,7 @@ private:
     void        _getLocation(ServerBlock &server_block);
     void        _getDirective(ServerBlock &server_block);
     void        _setDefaultValues(ServerBlock &server_block);
+    void        _parseServerBlocks();
 
 public:
 // Constructor
@@ -50,6 +66,14 @@ public:
 
 // Member functions
     void    parse(std::string config);
+    void    parseContent(const std::string &content);
+
+// Exception class, thrown after an error in the config is logged
+    class ConfigError : public std::exception
+    {
+    public:
+        const char  *what() const throw();
+    };
 
 };
 
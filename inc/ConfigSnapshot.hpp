@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+/*
+compiled configuration, read-only once it is built and shared by all connections:
+    - a request holds a reference while it is in flight (acquire(), release()),
+      the snapshot is deleted with its last reference
+    - a reload swaps in a new snapshot, requests in flight finish on the old one
+*/
+class ConfigSnapshot
+{
+private:
+    std::vector<ServerBlock>    _server_blocks;
+    size_t                      _generation;
+    size_t                      _refs;
+
+// not copyable, it owns the root fds of its server blocks
+    ConfigSnapshot(const ConfigSnapshot &rhs);
+    ConfigSnapshot &operator=(const ConfigSnapshot &rhs);
+
+// Deconstructor (release() deletes the snapshot)
+    ~ConfigSnapshot();
+
+public:
+// Constructor
+    ConfigSnapshot(std::vector<ServerBlock> &server_blocks, size_t generation);
+
+// Getters
+    const std::vector<ServerBlock>  &getServerBlocks() const;
+    size_t                          getGeneration() const;
+
+// Member functions
+    ConfigSnapshot  *acquire();
+    void            release();
+
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+/* ======== FastCGI Protocol ========== */
+#define FCGI_VERSION_1                              1
+#define FCGI_HEADER_LEN                             8
+#define FCGI_MAX_CONTENT_LEN                        65535
+#define FCGI_REQUEST_ID                             1
+#define FCGI_RESPONDER                              1
+#define FCGI_KEEP_CONN                              1
+
+enum FastCgiRecordType
+{
+    FCGI_BEGIN_REQUEST = 1,
+    FCGI_ABORT_REQUEST = 2,
+    FCGI_END_REQUEST = 3,
+    FCGI_PARAMS = 4,
+    FCGI_STDIN = 5,
+    FCGI_STDOUT = 6,
+    FCGI_STDERR = 7,
+};
+
+class FastCgiPool
+{
+private:
+    static std::map<std::string, std::vector<int> >    _idle;
+
+// Private static member functions
+    static int  _connect(const std::string &address);
+
+public:
+// Static member functions
+    static int  acquire(const std::string &address);
+    static void release(const std::string &address, int fd);
+
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Webserv.hpp"
+
+enum MultipartState
+{
+    MULTIPART_PREAMBLE,
+    MULTIPART_BOUNDARY,
+    MULTIPART_HEADERS,
+    MULTIPART_CONTENT,
+    MULTIPART_EPILOGUE,
+};
+
+class Multipart
+{
+private:
+    MultipartState                      _state;
+    int                                 _error;
+    std::string                         _delimiter;
+    size_t                              _skip[256];
+    std::string                         _buffer;
+    std::string                         _upload_dir;
+    std::string                         _path;
+    int                                 _fd;
+    UploadFsync                         _sync;
+    size_t                              _files;
+    bool                                _created;
+
+// Private Member functions
+    size_t  _search(const char *data, size_t len) const;
+    void    _process();
+    bool    _openPart(const std::string &headers);
+    bool    _writePart(const char *data, size_t len);
+    bool    _closePart();
+    void    _fail(int error);
+
+// not copyable, it owns the file of the current part
+    Multipart(const Multipart &rhs);
+    Multipart &operator=(const Multipart &rhs);
+
+public:
+// Constructor
+    Multipart(const std::string &boundary, const std::string &upload_dir, UploadFsync sync);
+
+// Deconstructor
+    ~Multipart();
+
+// Member functions
+    void    feed(const char *data, size_t len);
+    int     finish();
+
+// Static member functions
+    static std::string  getBoundary(const std::string &content_type);
+
+};
@@ -11,6 +11,8 @@ enum HttpMethod
     GET,
     POST,
     DELETE,
+    PUT,
+    HEAD,
 };
 
 enum ParsingState
@@ -49,7 +51,37 @@ enum ParsingState
     Parsing_Finished,
 };
 
+/*
+the header fields the server itself looks at, each one has a fixed slot in the request
+*/
+enum KnownHeader
+{
+    HEADER_HOST,
+    HEADER_CONTENT_LENGTH,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_TYPE,
+    HEADER_CONTENT_ENCODING,
+    HEADER_EXPECT,
+    HEADER_RANGE,
+    HEADER_CONTENT_RANGE,
+    HEADER_OTHER,
+};
+
 class Socket;
+class ConfigSnapshot;
+
+/*
+a header field as offsets into the buffer of the request head
+*/
+struct HeaderField
+{
+    size_t      _name;
+    size_t      _name_len;
+    size_t      _value;
+    size_t      _value_len;
+    KnownHeader _id;
+};
 
 class Request
 {
@@ -57,31 +89,53 @@ private:
     ParsingState                                    _state;
     int                                             _error;
     HttpMethod                                      _method;
+    char*                                           _raw;
+    size_t                                          _raw_len;
+    size_t                                          _raw_size;
     std::string                                     _path;
-    std::string                                     _query;
-    std::string                                     _fragment;
+    size_t                                          _path_start;
+    size_t                                          _query_start;
+    size_t                                          _query_len;
+    size_t                                          _fragment_start;
+    size_t                                          _fragment_len;
     int                                             _version_major;
     int                                             _version_minor;
-    std::map<std::string, std::string>              _headers;
+    HeaderField                                     _known[HEADER_OTHER];
+    unsigned                                        _repeated;
+    std::vector<HeaderField>                        _fields;
+    HeaderField                                     _field;
+    bool                                            _keep_alive;
+    bool                                            _close;
     std::string                                     _body;
     std::string                                     _method_str;
-    std::string                                     _header_field_name;
-    std::string                                     _header_field_value;
-    std::string                                     _chunk_length_str;
-    std::stringstream                               _ss;
+    size_t                                          _chunk_digits;
     size_t                                          _uri_len;
     size_t                                          _header_len;
     size_t                                          _body_len;
     size_t                                          _chunk_len;
+    size_t                                          _content_length;
+    int                                             _body_fd;
     bool                                            _body_flag;
     bool                                            _chunked_transfer_flag;
+    bool                                            _expect_continue;
+    bool                                            _body_encoded;
+    z_stream*                                       _inflate;
     size_t                                          _client_max_body_size;
-    std::vector<ServerBlock>                        _server_blocks;
-    ServerBlock*                                    _server;
+    ConfigSnapshot*                                 _config;
+    const ServerBlock*                              _server;
     Socket*                                         _socket;
 
 // Private Member functions
-    void                                        _findServerBlock(std::string host);
+    bool                                        _lendRaw(size_t size);
+    void                                        _findServerBlock(const HeaderField *host);
+    bool                                        _addHeader();
+    void                                        _removeHeader(KnownHeader id);
+    bool                                        _setupDecoding();
+    void                                        _decodeBody(size_t start);
+    void                                        _endDecoding();
+
+// not assignable, _raw is lent from the buffer pool (the copy constructor lends an own one)
+    Request &operator=(const Request &rhs);
 
 public:
 // Constructor
@@ -99,22 +153,41 @@ public:
     int                                         getVersionMinor() const;
     ParsingState                                getParsingState() const;
     HttpMethod                                  getMethod() const;
-    ServerBlock*                                getServerBlock() const;
+    ConfigSnapshot*                             getConfig() const;
+    const ServerBlock*                          getServerBlock() const;
     Socket*                                     getSocket() const;
     const std::string&                          getMethodStr() const;
     const std::string&                          getPath() const;
-    const std::string&                          getQuery() const;
-    const std::string&                          getFragment() const;
+    std::string                                 getQuery() const;
+    std::string                                 getFragment() const;
     const std::string&                          getBody() const;
-    const std::map<std::string, std::string>&   getHeaders() const;
+    size_t                                      getContentLength() const;
+    size_t                                      getRemainingBody() const;
+    int                                         getBodyFd() const;
+    std::map<std::string, std::string>          getHeaders() const;
+    std::string                                 getHeader(KnownHeader id) const;
+    std::string                                 getHeader(const char *name) const;
+    bool                                        hasHeader(KnownHeader id) const;
+    bool                                        hasHeader(const char *name) const;
 
 // Setters
-    void                                        setServerBlocks(std::vector<ServerBlock> &server_blocks);
-    void                                        setServerBlock(ServerBlock *server_block);
+    void                                        setConfig(ConfigSnapshot *config);
+    void                                        setServerBlock(const ServerBlock *server_block);
     void                                        setSocket(Socket* socket);
+    void                                        setError(int error);
 
 // Member functions
     void                                        parse(uint8_t *data, size_t size);
+    bool                                        isReadingBody() const;
+    bool                                        expectsContinue() const;
+    bool                                        isKeepAlive() const;
+    bool                                        isBodyEncoded() const;
+    bool                                        spillBody();
+    void                                        trimBody(size_t n);
+    void                                        skipBody(size_t n);
     void                                        clear();
 
+// Static member functions
+    static KnownHeader                          lookupHeader(const char *name, size_t len);
+
 };
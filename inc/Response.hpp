@@ -3,6 +3,8 @@
 #include "Webserv.hpp"
 
 class Request;
+class CgiHandler;
+class Multipart;
 
 class Response
 {
@@ -11,20 +13,59 @@ class Response
         std::string                         _response;
         std::string                         _body;
         sockaddr_in                         _client_addr;
-        std::map<std::string, std::string>  _headers;
+        Arena                               _arena;
+        HeaderMap                           _headers;
+        CgiHandler*                         _cgi;
+        Multipart*                          _multipart;
+        std::string                         _cache_key;
+        bool                                _cache_bypass;
+        bool                                _revalidate;
+        int                                 _file_fd;
+        off_t                               _file_offset;
+        size_t                              _file_remaining;
+        int                                 _stream_pipe[2];
+        size_t                              _stream_pending;
+        off_t                               _stream_remaining;
+        bool                                _stream_chunked;
+        bool                                _stream_eof;
+        int                                 _upload_fd;
+        int                                 _upload_pipe[2];
+        int                                 _upload_status;
+        off_t                               _upload_offset;
+        off_t                               _upload_size;
+        bool                                _upload_created;
+        std::string                         _upload_path;
 
     // Private member functions
-        void        _handleRequest(Request &request, ServerBlock &server);
-        bool        _checkCgi(Request &request, ServerBlock &server, std::string path, Location &location);
-        void        _handleGet(ServerBlock &server, std::string path, Location &location);
-        void        _handlePost(Request &request, std::string path, Location &location);
+        void        _handleRequest(Request &request, const ServerBlock &server);
+        bool        _checkCgi(Request &request, const ServerBlock &server, std::string path, const Location &location);
+        void        _createCgi(Request &request, const ServerBlock &server, const Location &location, std::string path, std::string binary_path);
+        bool        _serveFromCache(Request &request, const Location &location);
+        void        _updateCache();
+        void        _handleGet(Request &request, const ServerBlock &server, std::string path, const Location &location);
+        void        _serveFile(Request &request, const std::string &path, int fd, const struct stat &file_info);
+        void        _checkSendfile(Request &request);
+        void        _handleHead(Request &request, const ServerBlock &server, std::string path, const Location &location);
+        int         _uploadTarget(Request &request, const std::string &path, const Location &location, std::string &target, int &flags, off_t &offset);
+        bool        _storeBody(Request &request, const std::string &path, int flags, off_t &offset, const char *data, size_t start, size_t len, const Location &location);
+        void        _handlePost(Request &request, std::string path, const Location &location);
+        bool        _openUpload(Request &request, const std::string &path, const Location &location);
+        int         _finishUpload(const Location &location);
+        void        _closeUpload();
         void        _handleDelete(std::string path);
         void        _setConnection(Request& request);
-        void        _buildErrorPage(ServerBlock &server);
+        void        _buildErrorPage(const ServerBlock &server);
+        void        _assembleResponse(Request &request, const ServerBlock &server);
 
     public:
     // Constructor
         Response();
+
+    // Copy Constructor
+        Response(const Response &rhs);
+
+    // Assignment Operator
+        Response &operator=(const Response &rhs);
     
     // Decosntructor
         ~Response();
@@ -32,14 +73,35 @@ class Response
     // Getters
         int                 getError() const;
         const std::string&  getResponse() const;
+        CgiHandler*         getCgi() const;
+        bool                needsRevalidation() const;
+
+    // Setters
+        void                bypassCache();
 
     // Member functions
         void        buildResponse(Request &request, sockaddr_in client_addr);
+        bool        buildCgi(Request &request, sockaddr_in client_addr);
+        bool        buildUpload(Request &request);
+        int         checkRequest(Request &request);
+        void        feedUpload(Request &request);
+        ssize_t     spliceUpload(Request &request, int socket_fd);
+        bool        isUploading() const;
+        bool        startCgi(Request &request);
+        void        rejectCgi(Request &request, size_t retry_after);
+        void        finishCgi(Request &request);
+        void        shareCgi(Request &request, const Response &leader);
+        bool        streamCgi(Request &request);
+        ssize_t     spliceCgi(int socket_fd);
+        bool        isStreaming() const;
         bool        checkConnection();
         void        trimResponse(int i);
+        ssize_t     sendFile(int socket_fd);
+        bool        isSent() const;
         void        clear();
     
 };
 
 // utils
 std::string intToStr(int n);
+bool        syncDirectory(const std::string &path);
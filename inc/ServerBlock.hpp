@@ -4,10 +4,18 @@
 
 class Socket;
 
+enum UploadFsync
+{
+    FSYNC_OFF,
+    FSYNC_FILE,
+    FSYNC_FULL,
+};
+
 struct AllowedMethods
 {
     bool                                _allow_get;
     bool                                _allow_delete;
+    bool                                _allow_put;
     bool                                _allow_post;
 };
 
@@ -16,10 +24,27 @@ struct Location
     std::string                         _alias;
     std::string                         _index;
     std::string                         _upload;
+    UploadFsync                         _upload_fsync;
     std::string                         _redirection;
     AllowedMethods                      _allowed_methods;
     std::map<std::string, std::string>  _cgi;
+    std::map<std::string, std::pair<size_t, size_t> >  _cgi_pool;
+    std::string                         _fastcgi_pass;
     bool                                _autoindex;
+    size_t                              _cgi_timeout;
+    size_t                              _cgi_limit_cpu;
+    size_t                              _cgi_limit_as;
+    size_t                              _cgi_limit_nofile;
+    size_t                              _cgi_max_concurrency;
+    size_t                              _cgi_queue_size;
+    size_t                              _cgi_queue_timeout;
+    size_t                              _cgi_queue_id;
+    bool                                _cgi_cache;
+    size_t                              _cgi_cache_ttl;
+    size_t                              _cgi_cache_stale;
+    std::vector<std::string>            _cgi_cache_key_headers;
+    bool                                _cgi_coalesce;
+    bool                                _cgi_stream;
 };
 
 struct ServerBlock
@@ -29,7 +54,10 @@ struct ServerBlock
     uint16_t                            _port;
     std::string                         _ip;
     std::string                         _root;
+    int                                 _root_fd;
     size_t                              _client_max_body_size;
+    size_t                              _client_body_buffer_size;
+    std::string                         _client_body_temp_path;
     std::map<int, std::string>          _error_pages;
     std::map<std::string, Location>     _locations;
     Socket*                             _socket;
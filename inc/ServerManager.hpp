@@ -4,21 +4,64 @@
 #include "Client.hpp"
 #include "Response.hpp"
 
+struct CgiQueue
+{
+    std::string                         _location;      // listen address, server name and path of its location
+    size_t                              _max_concurrency;
+    size_t                              _size;
+    size_t                              _timeout;
+    size_t                              _running;
+    std::deque<std::pair<int, time_t> > _waiting;
+};
+
 class ServerManager
 {
 private:
-    std::vector<ServerBlock>    _server_blocks;
+    std::string                 _config_path;
+    ConfigSnapshot              *_config;
     std::map<int, Socket>       _socket_map;
     std::map<int, Client>       _client_map;
+    std::map<int, int>          _cgi_fd_map;
+    std::vector<CgiQueue>       _cgi_queues;
+    std::map<int, size_t>       _cgi_queue_map;
+    std::vector<std::pair<Request*, Response*> >  _spares;
+    std::map<std::string, std::vector<int> >   _coalesced;
+    std::map<int, std::string>  _coalesced_keys;
     int                         _epoll_fd;
+    int                         _background_fd;
+
+    static volatile sig_atomic_t    _reload_requested;
 
 // Private member functions
+    void    _checkConfig(const std::vector<ServerBlock> &server_blocks);
+    void    _compileConfig(std::vector<ServerBlock> &server_blocks);
+    bool    _validateConfig(const std::string &content);
+    void    _reloadConfig();
     void    _acceptNewConnection(int fd);
     void    _closeConnection(int fd);
     void    _checkTimeout();
     void    _readRequest(Client &client);
     void    _sendResponse(Client &client);
+    void    _endResponse(Client &client);
+    void    _attachState(Client &client);
+    void    _detachState(Client &client);
     void    _findDefaultServer(Client &client);
+    void    _setClientEvents(int fd, uint32_t events);
+    void    _sendContinue(Client &client);
+    void    _revalidateCgi(Client &client);
+    bool    _coalesceCgi(Client &client);
+    void    _shareCgi(Client &leader);
+    void    _uncoalesceCgi(int fd);
+    void    _admitCgi(Client &client);
+    void    _rejectCgi(Client &client, size_t retry_after);
+    void    _releaseCgi(int fd);
+    void    _startCgi(Client &client);
+    void    _streamBody(Client &client);
+    void    _handleCgiEvent(int fd);
+    void    _finishCgi(Client &client);
+    void    _startStream(Client &client);
+    void    _streamCgi(Client &client);
+    void    _removeCgiFd(int fd);
 
 public:
 // Constructor
@@ -31,4 +74,7 @@ public:
     void    setup(std::string config);
     void    boot();
 
+// Static member functions
+    static void requestReload(int signal);
+
 };
@@ -7,12 +7,23 @@
 #include <signal.h>
 #include <dirent.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/epoll.h>
 #include <sys/stat.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/sendfile.h>
+#include <sys/mman.h>
+#include <linux/openat2.h>
+#include <limits.h>
+#include <zlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+#endif
 
 #include <iostream>
 #include <iomanip>
@@ -20,17 +31,26 @@
 #include <fstream>
 #include <ctime>
 #include <cstring>
+#include <cerrno>
 #include <cstdarg>
 #include <algorithm>
+#include <deque>
 #include <map>
 #include <vector>
 
+#include "Arena.hpp"
+#include "BufferPool.hpp"
 #include "ConfigParser.hpp"
 #include "ServerBlock.hpp"
+#include "ConfigSnapshot.hpp"
 #include "Request.hpp"
 #include "Logger.hpp"
 #include "Socket.hpp"
+#include "FastCgiPool.hpp"
 #include "CgiHandler.hpp"
+#include "CgiPool.hpp"
+#include "CgiCache.hpp"
+#include "Multipart.hpp"
 
 /* ========== Logger Settings ========== */
 #define LOGFILE_NAME                                "webserv.log"
@@ -50,35 +70,64 @@
 #define DEFAULT_NAME                                "default"
 #define DEFAULT_ROOT                                "docs/"
 #define DEFAULT_CLIENT_MAX_BODY_SIZE                10240
+#define DEFAULT_CLIENT_BODY_BUFFER_SIZE             16384
+#define DEFAULT_CGI_TIMEOUT                         30
+#define DEFAULT_CGI_QUEUE_TIMEOUT                   5
 
 
 /* ======== Technical Settings ========= */
-#define BACKLOG                                     5
+#define BACKLOG                                     SOMAXCONN
 #define MAX_EPOLL_EVENTS                            10
-#define MAX_CONNECTIONS                             10
+#define MAX_CONNECTIONS                             100000
+#define MAX_SPARE_STATES                            64
 #define MAX_URI_LENGTH                              4096
 #define MAX_HEADER_LENGTH                           8192
 #define CLIENT_CONNECTION_TIMEOUT                   60
+#define EPOLL_WAIT_TIMEOUT                          1000
+#define CGI_POOL_SHRINK_INTERVAL                    10
+#define FASTCGI_MAX_IDLE_CONNECTIONS                16
+#define CGI_CACHE_MAX_SIZE                          67108864
+#define CGI_CACHE_MAX_ENTRY_SIZE                    1048576
 #define REQUEST_READ_SIZE                           4096
+#define REQUEST_INFLATE_SIZE                        16384
 #define RESPONSE_WRITE_SIZE                         4096
+#define SENDFILE_CHUNK_SIZE                         1048576
+#define CGI_STREAM_CHUNK_SIZE                       65536
+#define CGI_BODY_BUFFER_SIZE                        65536
+#define UPLOAD_SPLICE_SIZE                          1048576
+#define MULTIPART_CHUNK_SIZE                        65536
+#define MULTIPART_MAX_HEADER_LENGTH                 8192
+#define ARENA_BLOCK_SIZE                            4096
+#define ARENA_ALIGNMENT                             16
+#define IO_BUFFER_SIZE                              4096
+#define IO_LARGE_BUFFER_SIZE                        32768
+#define BUFFER_POOL_SLAB_SIZE                       2097152
+#define BUFFER_POOL_HUGEPAGES                       false
 
 
 /* ========= HTTP Error Codes ========== */
 #define OK                                          200
 #define CREATED                                     201
 #define NO_CONTENT                                  204
+#define PARTIAL_CONTENT                             206
 #define MOVED_PERMANENTLY                           301
 #define BAD_REQUEST                                 400
 #define FORBIDDEN                                   403
 #define NOT_FOUND                                   404
 #define NOT_ALLOWED                                 405
+#define CONFLICT                                    409
 #define LENGTH_REQUIRED                             411
 #define PAYLOAD_TOO_LARGE                           413
 #define URI_TOO_LONG                                414
 #define UNSUPPORTED_MEDIA_TYPE                      415
+#define RANGE_NOT_SATISFIABLE                       416
+#define EXPECTATION_FAILED                          417
 #define REQUEST_HEADER_FIELDS_TOO_LARGE             431
 #define INTERNAL_SERVER_ERROR                       500
 #define NOT_IMPLEMENTED                             501
+#define BAD_GATEWAY                                 502
+#define SERVICE_UNAVAILABLE                         503
+#define GATEWAY_TIMEOUT                             504
 
 
 /* === ANSI escape codes for colors ==== */
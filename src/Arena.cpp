@@ -0,0 +1,107 @@
+#include "../inc/Webserv.hpp"
+
+// =============   Constructor   ============= //
+/*
+the first block is only allocated with the first allocation, a connection which
+never gets a response does not hold one
+*/
+Arena::Arena()
+{
+    _first = NULL;
+    _current = NULL;
+    _used = 0;
+}
+
+// ============   Deconstructor   ============ //
+Arena::~Arena()
+{
+    release();
+}
+
+// ==============   Getters   ================ //
+/*
+returns the size of all blocks the arena holds
+*/
+size_t Arena::getCapacity() const
+{
+    size_t capacity = 0;
+
+    for (Block *block = _first; block != NULL; block = block->_next)
+        capacity += block->_size;
+    return capacity;
+}
+
+// ================   Utils   ================ //
+/*
+rounds size up to ARENA_ALIGNMENT, so every allocation is aligned for any type
+*/
+static size_t   align(size_t size)
+{
+    return (size + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+}
+
+// ======   Private member functions   ======= //
+/*
+allocates a block with room for size bytes behind its header
+*/
+Arena::Block *Arena::_newBlock(size_t size)
+{
+    Block *block = static_cast<Block*>(::operator new(align(sizeof(Block)) + size));
+
+    block->_next = NULL;
+    block->_size = size;
+    return block;
+}
+
+// ======   Public member functions   ======= //
+/*
+returns size bytes, aligned for any type
+    - if the current block is full, a new one (at least ARENA_BLOCK_SIZE) is chained behind it
+*/
+void *Arena::allocate(size_t size)
+{
+    size = align(size);
+    if (_first == NULL)
+    {
+        _first = _newBlock(std::max(size, (size_t)ARENA_BLOCK_SIZE));
+        _current = _first;
+        _used = 0;
+    }
+    if (_used + size > _current->_size)
+    {
+        _current->_next = _newBlock(std::max(size, (size_t)ARENA_BLOCK_SIZE));
+        _current = _current->_next;
+        _used = 0;
+    }
+    _used += size;
+    return reinterpret_cast<char*>(_current) + align(sizeof(Block)) + _used - size;
+}
+
+/*
+gives all memory back at once, the first block is kept for the next request
+    - the blocks behind it are only there after a request which needed more than one block
+*/
+void Arena::reset()
+{
+    if (_first == NULL)
+        return ;
+    for (Block *block = _first->_next, *next; block != NULL; block = next)
+    {
+        next = block->_next;
+        ::operator delete(block);
+    }
+    _first->_next = NULL;
+    _current = _first;
+    _used = 0;
+}
+
+/*
+frees all blocks including the first one
+*/
+void Arena::release()
+{
+    reset();
+    ::operator delete(_first);
+    _first = NULL;
+    _current = NULL;
+}
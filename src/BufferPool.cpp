@@ -0,0 +1,108 @@
+#include "../inc/BufferPool.hpp"
+
+BufferPool::FreeBuffer  *BufferPool::_free[2] = {NULL, NULL};
+char                    *BufferPool::_slab = NULL;
+size_t                  BufferPool::_slab_used = BUFFER_POOL_SLAB_SIZE;
+size_t                  BufferPool::_reserved = 0;
+size_t                  BufferPool::_lent = 0;
+
+// ================   Utils   ================ //
+/*
+maps a slab, backed by hugepages if the system has some reserved (BUFFER_POOL_HUGEPAGES),
+otherwise the kernel is asked to use transparent hugepages for it
+*/
+static char *mapSlab()
+{
+    void    *slab = MAP_FAILED;
+
+    if (BUFFER_POOL_HUGEPAGES)
+        slab = mmap(NULL, BUFFER_POOL_SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (slab == MAP_FAILED)
+    {
+        slab = mmap(NULL, BUFFER_POOL_SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (slab == MAP_FAILED)
+            return NULL;
+        if (BUFFER_POOL_HUGEPAGES)
+            madvise(slab, BUFFER_POOL_SLAB_SIZE, MADV_HUGEPAGE);
+    }
+    return static_cast<char*>(slab);
+}
+
+// ======   Private member functions   ======= //
+/*
+cuts a new buffer off the current slab, a new slab is mapped when the buffer does not fit anymore
+    - the pages of a slab are only touched once its buffers are used
+*/
+char *BufferPool::_carve(size_t size)
+{
+    char    *buffer;
+
+    if (_slab_used + size > BUFFER_POOL_SLAB_SIZE)
+    {
+        if ((_slab = mapSlab()) == NULL)
+            return NULL;
+        _slab_used = 0;
+        _reserved += BUFFER_POOL_SLAB_SIZE;
+    }
+    buffer = _slab + _slab_used;
+    _slab_used += size;
+    return buffer;
+}
+
+// =======   Static member functions   ======= //
+/*
+lends a buffer of at least size bytes, size is set to the size of the buffer
+    - returns NULL if size is larger than IO_LARGE_BUFFER_SIZE or no memory could be mapped
+*/
+char *BufferPool::acquire(size_t &size)
+{
+    int     large = size > IO_BUFFER_SIZE;
+    char    *buffer;
+
+    if (size > IO_LARGE_BUFFER_SIZE)
+        return NULL;
+    size = large ? IO_LARGE_BUFFER_SIZE : IO_BUFFER_SIZE;
+    if (_free[large] != NULL)
+    {
+        buffer = reinterpret_cast<char*>(_free[large]);
+        _free[large] = _free[large]->_next;
+    }
+    else if ((buffer = _carve(size)) == NULL)
+    {
+        Logger::log(RED, ERROR, "Mapping memory for the buffer pool failed: %s", strerror(errno));
+        return NULL;
+    }
+    _lent += size;
+    return buffer;
+}
+
+/*
+takes a buffer back (a NULL buffer is ignored), size is the size acquire() set
+*/
+void BufferPool::release(char *buffer, size_t size)
+{
+    int         large = size > IO_BUFFER_SIZE;
+    FreeBuffer  *free_buffer = reinterpret_cast<FreeBuffer*>(buffer);
+
+    if (buffer == NULL)
+        return ;
+    free_buffer->_next = _free[large];
+    _free[large] = free_buffer;
+    _lent -= size;
+}
+
+/*
+returns the bytes mapped for the pool
+*/
+size_t BufferPool::getReserved()
+{
+    return _reserved;
+}
+
+/*
+returns the bytes of the buffers which are lent at the moment
+*/
+size_t BufferPool::getLent()
+{
+    return _lent;
+}
@@ -0,0 +1,179 @@
+#include "../inc/CgiCache.hpp"
+
+std::map<std::string, CgiCacheEntry>    CgiCache::_entries;
+size_t                                  CgiCache::_size = 0;
+
+// ================   Utils   ================ //
+/*
+reads the directives of a Cache-Control header, which matter for a shared cache:
+    - no-store, no-cache and private forbid caching
+    - s-maxage (or max-age) overrides ttl, stale-while-revalidate overrides stale
+    - returns false if the response must not be cached
+*/
+static bool parseCacheControl(const std::string &value, size_t &ttl, size_t &stale)
+{
+    std::istringstream  iss(value);
+    std::string         directive;
+    bool                s_maxage = false;
+
+    while (std::getline(iss, directive, ','))
+    {
+        size_t start = directive.find_first_not_of(" \t");
+        size_t end = directive.find_last_not_of(" \t");
+
+        if (start == std::string::npos)
+            continue ;
+        directive = directive.substr(start, end - start + 1);
+        for (size_t i = 0; i < directive.size(); i++)
+            directive[i] = std::tolower(directive[i]);
+        if (directive == "no-store" || directive == "no-cache" || directive == "private")
+            return false;
+        if (directive.compare(0, 9, "s-maxage=") == 0)
+        {
+            ttl = strtoul(directive.c_str() + 9, NULL, 10);
+            s_maxage = true;
+        }
+        else if (directive.compare(0, 8, "max-age=") == 0 && !s_maxage)
+            ttl = strtoul(directive.c_str() + 8, NULL, 10);
+        else if (directive.compare(0, 23, "stale-while-revalidate=") == 0)
+            stale = strtoul(directive.c_str() + 23, NULL, 10);
+    }
+    return true;
+}
+
+/*
+converts an HTTP date ("Sun, 06 Nov 1994 08:49:37 GMT") into a time_t, returns 0 if invalid
+*/
+static time_t parseHttpDate(const std::string &value)
+{
+    struct tm   tm;
+
+    std::memset(&tm, 0, sizeof(tm));
+    if (strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm) == NULL)
+        return 0;
+    return timegm(&tm);
+}
+
+// ======   Private member functions   ======= //
+/*
+removes an entry and its size from the cache
+*/
+void CgiCache::_erase(std::map<std::string, CgiCacheEntry>::iterator it)
+{
+    _size -= it->first.size() + it->second._body.size();
+    _entries.erase(it);
+}
+
+/*
+removes all entries which are not even allowed to be served stale anymore
+*/
+void CgiCache::_purge(time_t now)
+{
+    std::map<std::string, CgiCacheEntry>::iterator it = _entries.begin();
+
+    while (it != _entries.end())
+    {
+        std::map<std::string, CgiCacheEntry>::iterator next = it;
+
+        next++;
+        if (now > it->second._stale_until)
+            _erase(it);
+        it = next;
+    }
+}
+
+// =======   Static member functions   ======= //
+/*
+builds the cache key of a cgi request: method, host, path and query
+and the values of the request headers listed in cgi_cache_key_headers
+*/
+std::string CgiCache::buildKey(const Request &request, const Location &location)
+{
+    std::string key;
+
+    key = request.getMethodStr() + " ";
+    if (request.hasHeader(HEADER_HOST))
+        key += request.getHeader(HEADER_HOST);
+    else if (request.getServerBlock() != NULL)
+        key += request.getServerBlock()->_ip + ":" + intToStr(request.getServerBlock()->_port);
+    key += request.getPath() + "?" + request.getQuery();
+    for (size_t i = 0; i < location._cgi_cache_key_headers.size(); i++)
+    {
+        key += "\n" + location._cgi_cache_key_headers[i] + ": ";
+        key += request.getHeader(location._cgi_cache_key_headers[i].c_str());
+    }
+    return key;
+}
+
+/*
+returns the entry for the key, or NULL if there is none
+    - the entry can be stale (now > _expires), it may be served until _stale_until
+      while a refresh is running
+*/
+CgiCacheEntry *CgiCache::lookup(const std::string &key, time_t now)
+{
+    std::map<std::string, CgiCacheEntry>::iterator it = _entries.find(key);
+
+    if (it == _entries.end())
+        return NULL;
+    if (now > it->second._stale_until)
+    {
+        _erase(it);
+        return NULL;
+    }
+    return &it->second;
+}
+
+/*
+stores the result of a cgi, if the script allows it:
+    - the ttl comes from Cache-Control or Expires of the script, otherwise from cgi_cache
+    - responses with Set-Cookie, X-Sendfile, another Status than 200 or no ttl are not cached
+      and replace nothing but the entry of the key
+    - if the cgi failed, a stale entry is kept (it can still be served until _stale_until)
+    - entries larger than CGI_CACHE_MAX_ENTRY_SIZE or not fitting into CGI_CACHE_MAX_SIZE are not stored
+*/
+void CgiCache::store(const std::string &key, int status, const HeaderMap &headers, const std::string &body, const Location &location)
+{
+    std::map<std::string, CgiCacheEntry>::iterator      it = _entries.find(key);
+    HeaderMap::const_iterator                           header;
+    size_t                                              ttl = location._cgi_cache_ttl;
+    size_t                                              stale = location._cgi_cache_stale;
+    time_t                                              now = time(NULL);
+    bool                                                cacheable = true;
+
+    if (status != OK)
+    {
+        if (it != _entries.end())
+            it->second._refreshing = false;
+        return ;
+    }
+    if (headers.count("Set-Cookie") || headers.count("X-Accel-Redirect") || headers.count("X-Sendfile") || body.size() > CGI_CACHE_MAX_ENTRY_SIZE)
+        cacheable = false;
+    if ((header = headers.find("Status")) != headers.end() && header->second.compare(0, 3, "200") != 0)
+        cacheable = false;
+    if ((header = headers.find("Cache-Control")) != headers.end())
+        cacheable = cacheable && parseCacheControl(header->second, ttl, stale);
+    else if ((header = headers.find("Expires")) != headers.end())
+        ttl = parseHttpDate(header->second) > now ? parseHttpDate(header->second) - now : 0;
+    if (it != _entries.end())
+        _erase(it);
+    if (!cacheable || ttl == 0)
+        return ;
+    if (_size + key.size() + body.size() > CGI_CACHE_MAX_SIZE)
+        _purge(now);
+    if (_size + key.size() + body.size() > CGI_CACHE_MAX_SIZE)
+    {
+        Logger::log(YELLOW, INFO, "CGI cache is full, not storing response");
+        return ;
+    }
+
+    CgiCacheEntry &entry = _entries[key];
+
+    entry._headers.insert(headers.begin(), headers.end());
+    entry._body = body;
+    entry._stored = now;
+    entry._expires = now + ttl;
+    entry._stale_until = entry._expires + stale;
+    entry._refreshing = false;
+    _size += key.size() + body.size();
+}
@@ -1,43 +1,133 @@
 #include "../inc/CgiHandler.hpp"
 
 // =============   Constructor   ============= //
-CgiHandler::CgiHandler(Request &request, ServerBlock &server, std::string script_path, std::string binary_path, sockaddr_in client_addr) : _request(request), _server(server)
+CgiHandler::CgiHandler(Request &request, const ServerBlock &server, const Location &location, std::string script_path, std::string binary_path, sockaddr_in client_addr) : _request(request), _server(server), _location(location)
 {
     _state = CGI_HEADER_START;
     _script_path = script_path;
     _binary_path = binary_path;
     _body = "";
+    _output = "";
     _error = OK;
     _client_addr = client_addr;
+    _pid = -1;
+    _pidfd = -1;
+    _in_fd = -1;
+    _out_fd = -1;
+    _in_offset = 0;
+    _status = 0;
+    _deadline = 0;
+    _exited = false;
+    _started = false;
+    _parsed = false;
+    _timed_out = false;
+    _fastcgi = false;
+    _fcgi_stdin_closed = false;
+    _fcgi_ended = false;
 }
 
 // ============   Deconstructor   ============ //
+/*
+kills the process group of a cgi which is still running and hands it over to reapOrphans()
+*/
 CgiHandler::~CgiHandler()
 {
-    if (_env != NULL)
-	{
-		for (size_t i = 0; _env[i]; i++)
-			delete[] _env[i];
-		delete[] _env;
-	}
+    if (_pid > 0 && !_exited)
+    {
+        kill(-_pid, SIGKILL);
+        _orphans.push_back(_pid);
+    }
+    if (_in_fd >= 0)
+        close(_in_fd);
+    if (_out_fd >= 0)
+        close(_out_fd);
+    if (_pidfd >= 0)
+        close(_pidfd);
 }
 
+std::vector<pid_t> CgiHandler::_orphans;
+
 // ==============   Getters   ================ //
 int CgiHandler::getError() const
 {
     return _error;
 }
 
+int CgiHandler::getInputFd() const
+{
+    return _in_fd;
+}
+
+int CgiHandler::getOutputFd() const
+{
+    return _out_fd;
+}
+
+int CgiHandler::getPidFd() const
+{
+    return _pidfd;
+}
+
 const std::map<std::string, std::string>& CgiHandler::getHeaders() const
 {
     return _headers;
 }
 
+const Location& CgiHandler::getLocation() const
+{
+    return _location;
+}
+
 std::string CgiHandler::getBody() const
 {
     return _body;
 }
 
+// ================   Utils   ================ //
+/*
+setting an fd into non-blocking mode
+    - on success, zero is returned
+    - on error, -1 is returned, and errno is set to indicate the error.
+*/
+static int  setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1)
+        return -1;
+    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+        return -1;
+    return 0;
+}
+
+/*
+sets soft and hard limit of a resource for the calling process
+    - a limit of 0 means, that the limit is not configured and stays untouched
+*/
+static void setResourceLimit(int resource, size_t limit)
+{
+    struct rlimit rl;
+
+    if (limit == 0)
+        return ;
+    rl.rlim_cur = limit;
+    rl.rlim_max = limit;
+    setrlimit(resource, &rl);
+}
+
+/*
+opens a pidfd for the process, which becomes readable in epoll as soon as the process exits
+    - on error or if the kernel does not support pidfds, -1 is returned
+*/
+static int  openPidFd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
 // ======   Private member functions   ======= //
 /*
 checks if the header from the cgi output is vaild and inserts it into the header map
@@ -77,9 +167,11 @@ bool CgiHandler::_addHeader(std::string &header_name, std::string &header_value)
     valid_headers.push_back("Transfer-Encoding");
     valid_headers.push_back("Vary");
     valid_headers.push_back("WWW-Authenticate");
+    valid_headers.push_back("X-Accel-Redirect");
     valid_headers.push_back("X-Content-Type-Options");
     valid_headers.push_back("X-Frame-Options");
     valid_headers.push_back("X-Requested-With");
+    valid_headers.push_back("X-Sendfile");
 
     if (find(valid_headers.begin(), valid_headers.end(), header_name) != valid_headers.end())
     {
@@ -187,10 +279,10 @@ void CgiHandler::_parseCgi(std::string &output)
 		}
     }
 
-    // extract body
+    // extract body (output without a complete header block is all body)
     if (_body.empty())
     {
-        if (output[i])
+        if (parsing_finished)
             _body = output.substr(i, output.size() - i);
         else
             _body = output;
@@ -210,93 +302,288 @@ void CgiHandler::_parseCgi(std::string &output)
 }
 
 /*
-reads cgi output from fd
+appends "name=value" to the environment block of the cgi
+    - the value ends at the first '\0', so every entry stays a single c-string
 */
-void CgiHandler::_readCgi(int fd) 
+void CgiHandler::_addEnv(const char *name, const std::string &value)
 {
-    const int BUFSIZE = 4096;
-	char buffer[BUFSIZE];
-	int bytesRead = 1;
-	std::string output;
-
-	while (bytesRead > 0) 
-    {		
-		bytesRead = read(fd, buffer, BUFSIZE);
-		if (bytesRead < 0)
-        {
-            _error = INTERNAL_SERVER_ERROR;
-            Logger::log(RED, ERROR, "CGI: Read error on fd[%i]: %s", fd, strerror(errno));
-            return;
-        }
-		output.append(buffer, bytesRead);
-	}
-    _parseCgi(output);
+    _env_block.append(name);
+    _env_block.push_back('=');
+    _env_block.append(value.c_str());
+    _env_block.push_back('\0');
 }
 
 /*
 building the environment for the cgi call
+    - all entries are written into one contiguous block, _env points into it (NULL terminated)
+    - SCRIPT_FILENAME is absolute, a FastCGI server resolves relative paths against its own cwd
 */
 void CgiHandler::_buildEnvironment()
 {
-    std::map<std::string, std::string> tmp_env;
+    const std::map<std::string, std::string> headers = _request.getHeaders();
+    size_t size = 512;
+    char   real_path[PATH_MAX];
+    std::string script_filename = realpath(_script_path.c_str(), real_path) != NULL ? real_path : _script_path;
+
+    // reserve the whole block up front, so it is filled without reallocating
+    for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); it++)
+        size += it->first.size() + it->second.size() + 7;
+    _env_block.reserve(size + _script_path.size() + script_filename.size() + _request.getPath().size() * 2 + _request.getQuery().size());
 
-    // build temporary environment
     if (_request.getMethod() == POST)
     {
-        tmp_env["CONTENT_LENGTH"] = intToStr(_request.getBody().size());
-        tmp_env["CONTENT_TYPE"] = const_cast<std::map<std::string, std::string>&>(_request.getHeaders())["Content-Type"];
-    }
-    tmp_env["AUTH_TYPE"] = "";
-    tmp_env["PATH_INFO"] = _request.getPath(); // must be full path (requested by subject)
-    tmp_env["PATH_TRANSLATED"] = _server._root + _request.getPath();
-    tmp_env["QUERY_STRING"] = _request.getQuery();
-    tmp_env["REMOTE_ADDR"] = inAddrToIpString(_client_addr.sin_addr.s_addr);
-    // tmp_env["REMOTE_HOST"] = ""; // not needed
-    // tmp_env["REMOTE_IDENT"] = ""; // not needed
-    // tmp_env["REMOTE_USER"] = ""; // not needed
-    tmp_env["REQUEST_METHOD"] = _request.getMethodStr();
-    tmp_env["SCRIPT_NAME"] = _script_path;
-    tmp_env["SERVER_NAME"] = _server._ip; // takes the first server name
-    tmp_env["SERVER_PORT"] = intToStr(_server._port);
-    tmp_env["SERVER_PROTOCOL"] = "HTTP/1.1";
-    tmp_env["SERVER_SOFTWARE"] = "Webserv";
-    tmp_env["REDIRECT_STATUS"] = intToStr(_request.getError());
-
-    // add request headers to env
-	for(std::map<std::string, std::string>::const_iterator it = _request.getHeaders().begin(); it != _request.getHeaders().end(); it++)
-	{
-		std::string name = "HTTP_" + it->first;
+        std::map<std::string, std::string>::const_iterator content_type = headers.find("Content-Type");
+
+        _addEnv("CONTENT_LENGTH", intToStr(_request.getContentLength()));
+        _addEnv("CONTENT_TYPE", content_type != headers.end() ? content_type->second : "");
+    }
+    _addEnv("AUTH_TYPE", "");
+    _addEnv("PATH_INFO", _request.getPath()); // must be full path (requested by subject)
+    _addEnv("PATH_TRANSLATED", _server._root + _request.getPath());
+    _addEnv("QUERY_STRING", _request.getQuery());
+    _addEnv("REMOTE_ADDR", inAddrToIpString(_client_addr.sin_addr.s_addr));
+    // REMOTE_HOST, REMOTE_IDENT, REMOTE_USER are not needed
+    _addEnv("REQUEST_METHOD", _request.getMethodStr());
+    _addEnv("SCRIPT_NAME", _script_path);
+    _addEnv("SCRIPT_FILENAME", script_filename);
+    _addEnv("SERVER_NAME", _server._ip); // takes the first server name
+    _addEnv("SERVER_PORT", intToStr(_server._port));
+    _addEnv("SERVER_PROTOCOL", "HTTP/1.1");
+    _addEnv("SERVER_SOFTWARE", "Webserv");
+    _addEnv("REDIRECT_STATUS", intToStr(_request.getError()));
+
+    // add request headers to env: upper case, '-' replaced with '_'
+    for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); it++)
+    {
+        _env_block.append("HTTP_");
+        for (size_t i = 0; i < it->first.size(); i++)
+            _env_block.push_back(it->first[i] == '-' ? '_' : std::toupper(it->first[i]));
+        _env_block.push_back('=');
+        _env_block.append(it->second.c_str());
+        _env_block.push_back('\0');
+    }
 
-        for (size_t i = 0; i < name.size(); i++)
+    // the pointers for execve are taken once the block does not move anymore
+    for (size_t pos = 0; pos < _env_block.size(); pos += std::strlen(&_env_block[pos]) + 1)
+        _env.push_back(&_env_block[pos]);
+    _env.push_back(NULL);
+}
+
+
+/*
+appends the content as FastCGI records of the given type to the output buffer of the connection
+    - content longer than FCGI_MAX_CONTENT_LEN gets split into several records
+    - an empty content appends an empty record, which ends the stream
+*/
+void CgiHandler::_appendRecords(uint8_t type, const char *content, size_t len)
+{
+    do
+    {
+        size_t  content_len = std::min(len, (size_t)FCGI_MAX_CONTENT_LEN);
+        char    header[FCGI_HEADER_LEN];
+
+        header[0] = FCGI_VERSION_1;
+        header[1] = type;
+        header[2] = 0;
+        header[3] = FCGI_REQUEST_ID;
+        header[4] = (content_len >> 8) & 0xff;
+        header[5] = content_len & 0xff;
+        header[6] = 0;
+        header[7] = 0;
+        _fcgi_out.append(header, FCGI_HEADER_LEN);
+        _fcgi_out.append(content, content_len);
+        content += content_len;
+        len -= content_len;
+    } while (len > 0);
+}
+
+/*
+appends the length of a FastCGI name-value pair (1 byte below 128, 4 bytes otherwise)
+*/
+static void appendParamLength(std::string &params, size_t len)
+{
+    if (len < 128)
+    {
+        params.push_back(len);
+        return ;
+    }
+    params.push_back(((len >> 24) & 0x7f) | 0x80);
+    params.push_back((len >> 16) & 0xff);
+    params.push_back((len >> 8) & 0xff);
+    params.push_back(len & 0xff);
+}
+
+/*
+starts the request on a pooled connection to the FastCGI server of the location:
+    - the connection gets read through _out_fd and written through a duplicate in _in_fd,
+      so the event loop can wait for both directions like on the pipes of a cgi
+    - the environment of the cgi is sent as FCGI_PARAMS, the body follows as FCGI_STDIN
+*/
+void CgiHandler::_execFastCgi()
+{
+    int         fd = FastCgiPool::acquire(_location._fastcgi_pass);
+    std::string params;
+    const char  begin_request[8] = {0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0};
+
+    _fastcgi = true;
+    _exited = true;
+    if (fd < 0)
+    {
+        Logger::log(RED, ERROR, "Could not connect to FastCGI server %s: %s", _location._fastcgi_pass.c_str(), strerror(errno));
+        _error = BAD_GATEWAY;
+        return ;
+    }
+    _out_fd = fd;
+    if ((_in_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0)
+    {
+        Logger::log(RED, ERROR, "Duplicating FastCGI connection fd[%i] failed: %s", fd, strerror(errno));
+        _error = INTERNAL_SERVER_ERROR;
+        return ;
+    }
+    for (size_t i = 0; _env[i]; i++)
+    {
+        const char  *separator = std::strchr(_env[i], '=');
+        size_t      name_len = separator - _env[i];
+        size_t      value_len = std::strlen(separator + 1);
+
+        appendParamLength(params, name_len);
+        appendParamLength(params, value_len);
+        params.append(_env[i], name_len);
+        params.append(separator + 1, value_len);
+    }
+    _appendRecords(FCGI_BEGIN_REQUEST, begin_request, sizeof(begin_request));
+    _appendRecords(FCGI_PARAMS, params.c_str(), params.size());
+    _appendRecords(FCGI_PARAMS, "", 0);
+    _deadline = time(NULL) + _location._cgi_timeout;
+    Logger::log(GREY, DEBUG, "Started FastCGI request on fd[%i] for script: %s", fd, _script_path.c_str());
+}
+
+/*
+writes the buffered records to the FastCGI server and encodes the next part of the body as FCGI_STDIN
+    - a body spooled to a file is read from there, one record at a time
+    - returns true if everything is sent (or on error) and the write side can be closed
+*/
+bool CgiHandler::_writeFastCgi()
+{
+    const std::string   &body = _request.getBody();
+    ssize_t             bytes_written;
+
+    if (_fcgi_out.empty() && !_fcgi_stdin_closed && _request.getBodyFd() >= 0)
+    {
+        char    buffer[FCGI_MAX_CONTENT_LEN];
+        ssize_t len = pread(_request.getBodyFd(), buffer, sizeof(buffer), _in_offset);
+
+        if (len < 0)
         {
-            // convert to upper case
-            name[i] = std::toupper(name[i]);
-            // replaced "-" with "_"
-            if (name[i] == '-')
-                name[i] = '_';
+            Logger::log(RED, ERROR, "FastCGI: Reading the spooled request body failed: %s", strerror(errno));
+            _error = INTERNAL_SERVER_ERROR;
+            return true;
         }
-		tmp_env[name] = it->second;
-	}
+        _appendRecords(FCGI_STDIN, buffer, len);
+        _in_offset += len;
+        _fcgi_stdin_closed = (len == 0);
+    }
+    else if (_fcgi_out.empty() && !_fcgi_stdin_closed)
+    {
+        size_t len = std::min(body.size() - _in_offset, (size_t)FCGI_MAX_CONTENT_LEN);
 
-    // builds environemnt as char** for the execve call
-    _env = new char*[tmp_env.size() + 1];
-    size_t i = 0;
-    for (std::map<std::string, std::string>::iterator it = tmp_env.begin(); it != tmp_env.end(); it++)
-	{
-		_env[i] = new char[it->first.size() + it->second.size() + 2];
-        std::string line = it->first + "=" + it->second;
-		std::strcpy(_env[i], line.c_str());
-        i++;
-	}
-	_env[tmp_env.size()] = NULL;
+        _appendRecords(FCGI_STDIN, body.c_str() + _in_offset, len);
+        _in_offset += len;
+        _fcgi_stdin_closed = (len == 0);
+    }
+    bytes_written = write(_in_fd, _fcgi_out.c_str(), _fcgi_out.size());
+    if (bytes_written < 0)
+    {
+        if (errno == EAGAIN)
+            return false;
+        Logger::log(RED, ERROR, "FastCGI: Write error on fd[%i]: %s", _in_fd, strerror(errno));
+        _error = BAD_GATEWAY;
+        return true;
+    }
+    _fcgi_out.erase(0, bytes_written);
+    return _fcgi_out.empty() && _fcgi_stdin_closed;
+}
+
+/*
+reads records from the FastCGI server:
+    - FCGI_STDOUT is collected like the output of a cgi, FCGI_STDERR gets logged
+    - returns true on FCGI_END_REQUEST, EOF or error and the read side can be closed
+*/
+bool CgiHandler::_readFastCgi()
+{
+    const int   BUFSIZE = 4096;
+    char        buffer[BUFSIZE];
+    ssize_t     bytes_read;
+
+    bytes_read = read(_out_fd, buffer, BUFSIZE);
+    if (bytes_read < 0 && errno == EAGAIN)
+        return false;
+    if (bytes_read <= 0)
+    {
+        Logger::log(RED, ERROR, "FastCGI: connection fd[%i] closed before end of request", _out_fd);
+        _error = BAD_GATEWAY;
+        return true;
+    }
+    _fcgi_in.append(buffer, bytes_read);
+    while (_fcgi_in.size() >= FCGI_HEADER_LEN)
+    {
+        const uint8_t   *header = (const uint8_t *)_fcgi_in.c_str();
+        size_t          content_len = (header[4] << 8) | header[5];
+        size_t          record_len = FCGI_HEADER_LEN + content_len + header[6];
+
+        if (_fcgi_in.size() < record_len)
+            break ;
+        if (header[1] == FCGI_STDOUT)
+            _output.append(_fcgi_in, FCGI_HEADER_LEN, content_len);
+        else if (header[1] == FCGI_STDERR)
+            Logger::log(YELLOW, INFO, "FastCGI stderr: %s", _fcgi_in.substr(FCGI_HEADER_LEN, content_len).c_str());
+        else if (header[1] == FCGI_END_REQUEST)
+            _fcgi_ended = true;
+        _fcgi_in.erase(0, record_len);
+        if (_fcgi_ended)
+            return true;
+    }
+    return false;
+}
+
+/*
+takes an idle worker from the interpreter pool, if the location has cgi_pool for the extension
+    - builds the handoff for the worker: the length of the payload (4 bytes, big endian)
+      followed by the resource limits, the script path and the environment, separated by '\0'
+    - returns false if there is no pool or no idle worker
+*/
+bool CgiHandler::_acquireWorker()
+{
+    size_t              pos = _script_path.find_last_of('.');
+    std::ostringstream  oss;
+    std::string         payload;
+
+    if (pos == std::string::npos || !_location._cgi_pool.count(_script_path.substr(pos)))
+        return false;
+    if (!CgiPool::acquire(_binary_path, _pid, _in_fd, _out_fd))
+        return false;
+    oss << _location._cgi_limit_cpu << '\0' << _location._cgi_limit_as << '\0' << _location._cgi_limit_nofile << '\0';
+    oss << _script_path << '\0';
+    payload = oss.str();
+    payload += _env_block;
+    _handoff.push_back((payload.size() >> 24) & 0xff);
+    _handoff.push_back((payload.size() >> 16) & 0xff);
+    _handoff.push_back((payload.size() >> 8) & 0xff);
+    _handoff.push_back(payload.size() & 0xff);
+    _handoff += payload;
+    return true;
 }
 
 // ==========   Member functions   =========== //
 /*
-executes cgi
+starts the cgi without waiting for it:
+    - the process is started by spawnProcess() or taken from the interpreter pool
+    - the request body is fed to stdin with writeInput(), the output is collected with
+      readOutput() and the process is reaped with reap(), all driven by the event loop
 */
 void CgiHandler::execCgi() 
 {
+    _started = true;
     try
     {
         _buildEnvironment();
@@ -313,67 +600,335 @@ void CgiHandler::execCgi()
     argv[1] = const_cast<char*>(_script_path.c_str());
     argv[2] = NULL;
 
-    int cgifd[2];
-    if (!_request.getBody().empty())
+    if (!_location._fastcgi_pass.empty())
     {
-        if (pipe(cgifd) == -1)
-        {
-            Logger::log(RED, ERROR, "Creating cgi pipe has failed, aborting CGI init process.");
-            return;
-        }
-        write(cgifd[1], _request.getBody().c_str(), _request.getBody().length());
-        close(cgifd[1]);
-    }
-    else 
-    {
-        cgifd[0] = 0;
-        cgifd[1] = 1;
+        _execFastCgi();
+        return ;
     }
-    int fd[2], pid, status;
-    if (pipe(fd) == -1)
+
+    // hand the request to an idle pre-spawned interpreter, or start the cgi from scratch
+    // (a spilled body becomes its stdin right away)
+    if (_acquireWorker())
+        Logger::log(GREY, DEBUG, "Handed script to pooled CGI worker[%i]: %s", _pid, _script_path.c_str());
+    else if (_request.getBodyFd() >= 0 && lseek(_request.getBodyFd(), 0, SEEK_SET) < 0)
     {
-        Logger::log(RED, ERROR, "Creating pipe has failed, aborting CGI init process.");
+        Logger::log(RED, ERROR, "Rewinding the request body failed: %s", strerror(errno));
         _error = INTERNAL_SERVER_ERROR;
         return;
     }
-    if ((pid = fork()) == -1)
+    else if ((_pid = spawnProcess(argv, &_env[0], &_location, _in_fd, _out_fd, _request.getBodyFd())) == -1)
     {
-        Logger::log(RED, ERROR, "Creating fork has failed, aborting CGI init process.");
         _error = INTERNAL_SERVER_ERROR;
         return;
     }
-    if (!pid)
+    _pidfd = openPidFd(_pid);
+    _deadline = time(NULL) + _location._cgi_timeout;
+    // nothing to write: the cgi reads EOF right away
+    if (_in_fd >= 0 && _request.getBody().empty() && _request.getBodyFd() < 0
+        && _request.getParsingState() == Parsing_Finished && _handoff.empty())
+    {
+        close(_in_fd);
+        _in_fd = -1;
+    }
+    Logger::log(GREY, DEBUG, "Started CGI process[%i] for script: %s", _pid, _script_path.c_str());
+}
+
+/*
+writes the next part of the request body into the stdin of the cgi
+    - a pooled worker first gets the handoff with limits, script and environment
+    - a body which is still arriving is written as far as it is there, the written part
+      gets trimmed from the request, so it never has to be held completely
+    - a spilled body is spliced from its memfd
+    - returns true if nothing is left to write and the fd can be closed
+*/
+bool CgiHandler::writeInput()
+{
+    const std::string   &body = _request.getBody();
+    ssize_t             bytes_written;
+
+    if (_fastcgi)
+        return _writeFastCgi();
+    // a pooled worker gets the handoff before the body
+    if (!_handoff.empty())
     {
-        if (dup2(fd[1], 1) == -1)
+        bytes_written = write(_in_fd, _handoff.c_str(), _handoff.size());
+        if (bytes_written < 0)
         {
-            Logger::log(RED, ERROR, "Child Process ID: %i: dup2 has failed (WRITE)", pid);
+            if (errno == EAGAIN)
+                return false;
+            Logger::log(RED, ERROR, "CGI: Write error on fd[%i]: %s", _in_fd, strerror(errno));
             _error = INTERNAL_SERVER_ERROR;
-            exit(EXIT_FAILURE);
+            return true;
         }
-        if (cgifd[0] != 0 && dup2(cgifd[0], 0) == -1) //if cgifd is not unset, set it now
-        { 
-            Logger::log(RED, ERROR, "Child Process ID: %i: dup2 has failed (READ)", pid);
-            _error = INTERNAL_SERVER_ERROR;
-            exit(EXIT_FAILURE);
+        _handoff.erase(0, bytes_written);
+        if (!_handoff.empty())
+            return false;
+    }
+    if (_request.getBodyFd() >= 0)
+    {
+        loff_t  offset = _in_offset;
+
+        bytes_written = splice(_request.getBodyFd(), &offset, _in_fd, NULL, _request.getContentLength() - _in_offset, SPLICE_F_NONBLOCK);
+        if (bytes_written < 0 && errno == EAGAIN)
+            return false;
+        if (bytes_written <= 0)
+        {
+            Logger::log(RED, ERROR, "CGI: Splicing the body into fd[%i] failed: %s", _in_fd, strerror(errno));
+            return true;
         }
-        execve(*argv, argv, _env);
-        Logger::log(RED, ERROR, "Child Process ID: %i: Execve has failed", pid);
+        _in_offset = offset;
+        return _in_offset >= _request.getContentLength();
+    }
+    if (_in_offset < body.size())
+    {
+        bytes_written = write(_in_fd, body.c_str() + _in_offset, body.size() - _in_offset);
+        if (bytes_written < 0)
+        {
+            if (errno == EAGAIN)
+                return false;
+            Logger::log(RED, ERROR, "CGI: Write error on fd[%i]: %s", _in_fd, strerror(errno));
+            return true;
+        }
+        _in_offset += bytes_written;
+    }
+    if (_in_offset >= body.size())
+    {
+        _request.trimBody(_in_offset);
+        _in_offset = 0;
+    }
+    return body.empty() && _request.getParsingState() == Parsing_Finished;
+}
+
+/*
+reads the available output of the cgi
+    - returns true on EOF or error and the fd can be closed
+*/
+bool CgiHandler::readOutput()
+{
+    const int   BUFSIZE = 4096;
+    char        buffer[BUFSIZE];
+    ssize_t     bytes_read;
+
+    if (_fastcgi)
+        return _readFastCgi();
+    bytes_read = read(_out_fd, buffer, BUFSIZE);
+    if (bytes_read < 0)
+    {
+        if (errno == EAGAIN)
+            return false;
         _error = INTERNAL_SERVER_ERROR;
-        exit(EXIT_FAILURE);
+        Logger::log(RED, ERROR, "CGI: Read error on fd[%i]: %s", _out_fd, strerror(errno));
+        return true;
+    }
+    if (bytes_read == 0)
+        return true;
+    if (_parsed)
+        _body.append(buffer, bytes_read);
+    else
+        _output.append(buffer, bytes_read);
+    return false;
+}
+
+/*
+reaps the cgi process without blocking
+    - returns true once the process is reaped
+*/
+bool CgiHandler::reap()
+{
+    if (!_exited && _pid > 0 && waitpid(_pid, &_status, WNOHANG) == _pid)
+        _exited = true;
+    return _exited;
+}
+
+/*
+checks the cgi_timeout of the location and kills the whole process group of the cgi when it is exceeded
+    - returns true if the cgi timed out
+*/
+bool CgiHandler::checkTimeout(time_t now)
+{
+    if (_timed_out)
+        return true;
+    if (now <= _deadline)
+        return false;
+    Logger::log(YELLOW, INFO, "CGI timeout: killing process group[%i] of script: %s", _pid, _script_path.c_str());
+    if (_pid > 0)
+        kill(-_pid, SIGKILL);
+    _timed_out = true;
+    _error = GATEWAY_TIMEOUT;
+    return true;
+}
+
+/*
+the cgi_timeout counts from the end of the request body, if the cgi got it while it arrived
+*/
+void CgiHandler::restartTimeout()
+{
+    _deadline = time(NULL) + _location._cgi_timeout;
+}
+
+/*
+the cgi is not started yet, while it waits for a free slot of its location
+*/
+bool CgiHandler::isStarted() const
+{
+    return _started;
+}
+
+/*
+parses the header block of the cgi, as soon as it is complete, before the cgi is finished
+    - the rest of the output is body, readOutput() appends it to the body from now on
+    - returns true only once, when the headers got parsed
+*/
+bool CgiHandler::parseHeaders()
+{
+    if (_parsed || _fastcgi)
+        return false;
+    if (_output.find("\n\n") == std::string::npos && _output.find("\n\r\n") == std::string::npos)
+        return false;
+    _parseCgi(_output);
+    _output.clear();
+    _parsed = true;
+    return true;
+}
+
+/*
+the cgi is finished when it timed out, or when its output is closed and the process is reaped
+*/
+bool CgiHandler::isFinished() const
+{
+    return _timed_out || (_out_fd < 0 && _exited);
+}
+
+/*
+closes one of the fds of the cgi, after the event loop removed it from the epoll instance
+    - a FastCGI connection with a cleanly finished request goes back to the pool instead
+*/
+void CgiHandler::closeFd(int fd)
+{
+    if (fd < 0)
+        return ;
+    if (fd == _in_fd)
+        _in_fd = -1;
+    else if (fd == _out_fd)
+    {
+        _out_fd = -1;
+        if (_fastcgi && _fcgi_ended && _fcgi_stdin_closed && _fcgi_out.empty() && _fcgi_in.empty())
+        {
+            FastCgiPool::release(_location._fastcgi_pass, fd);
+            return ;
+        }
     }
-    waitpid(pid, &status, 0);
-    if (!WIFEXITED(status))
+    else if (fd == _pidfd)
+        _pidfd = -1;
+    else
+        return ;
+    close(fd);
+}
+
+/*
+extracts headers and body from the collected output once the cgi is finished
+*/
+void CgiHandler::finish()
+{
+    if (_timed_out || _error != OK)
+        return ;
+    if (!_fastcgi && !WIFEXITED(_status))
     {
         _error = INTERNAL_SERVER_ERROR;
-        // close(fd[0]) ????
-        // close(fd[1]) ????
-        // close(cgifd[0]) ????
-        return;
+        return ;
+    }
+    if (!_parsed)
+        _parseCgi(_output);
+}
+
+// =======   Static member functions   ======= //
+/*
+starts a process with stdin and stdout connected to pipes:
+    - vfork() shares the memory of the server instead of copying its page tables, so starting
+      a cgi costs the same no matter how big the server got; the server is suspended until
+      the child called execve(), so the child only makes syscalls and leaves with _exit()
+    - the process runs in its own process group, so a timeout kills everything it spawned
+    - the resource limits of the location get applied in the child (if location is given)
+    - in_fd and out_fd are set to the non-blocking parent ends of the pipes
+    - with a stdin_fd (a spilled request body), the process reads it instead and in_fd is -1
+    - returns the pid, or -1 on error
+*/
+pid_t CgiHandler::spawnProcess(char **argv, char **env, const Location *location, int &in_fd, int &out_fd, int stdin_fd)
+{
+    int     in_pipe[2] = {stdin_fd, -1};
+    int     out_pipe[2];
+    pid_t   pid;
+
+    if (stdin_fd < 0 && pipe2(in_pipe, O_CLOEXEC) == -1)
+    {
+        Logger::log(RED, ERROR, "Creating cgi pipe has failed, aborting CGI init process.");
+        return -1;
+    }
+    if (pipe2(out_pipe, O_CLOEXEC) == -1)
+    {
+        Logger::log(RED, ERROR, "Creating pipe has failed, aborting CGI init process.");
+        if (stdin_fd < 0)
+        {
+            close(in_pipe[0]);
+            close(in_pipe[1]);
+        }
+        return -1;
+    }
+    if ((pid = vfork()) == -1)
+    {
+        Logger::log(RED, ERROR, "Creating vfork has failed, aborting CGI init process.");
+        if (stdin_fd < 0)
+        {
+            close(in_pipe[0]);
+            close(in_pipe[1]);
+        }
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        return -1;
+    }
+    if (!pid)
+    {
+        setpgid(0, 0);
+        if (location != NULL)
+        {
+            setResourceLimit(RLIMIT_CPU, location->_cgi_limit_cpu);
+            setResourceLimit(RLIMIT_AS, location->_cgi_limit_as);
+            setResourceLimit(RLIMIT_NOFILE, location->_cgi_limit_nofile);
+        }
+        // dup2() clears O_CLOEXEC on the new fds, the pipe ends themselves get closed by execve()
+        if (dup2(out_pipe[1], 1) == -1 || dup2(in_pipe[0], 0) == -1)
+            _exit(EXIT_FAILURE);
+        execve(*argv, argv, env);
+        _exit(EXIT_FAILURE);
+    }
+    if (stdin_fd < 0)
+        close(in_pipe[0]);
+    close(out_pipe[1]);
+    in_fd = in_pipe[1];
+    out_fd = out_pipe[0];
+    if ((in_fd >= 0 && setNonBlocking(in_fd) < 0) || setNonBlocking(out_fd) < 0)
+        Logger::log(RED, ERROR, "Setting cgi pipes non-blocking has failed: %s", strerror(errno));
+    return pid;
+}
+
+/*
+hands a process over to reapOrphans(), after it got killed or told to exit
+*/
+void CgiHandler::addOrphan(pid_t pid)
+{
+    _orphans.push_back(pid);
+}
+
+/*
+reaps killed cgi processes whose handler is already gone, without blocking
+*/
+void CgiHandler::reapOrphans()
+{
+    for (size_t i = 0; i < _orphans.size();)
+    {
+        if (waitpid(_orphans[i], NULL, WNOHANG) != 0)
+            _orphans.erase(_orphans.begin() + i);
+        else
+            i++;
     }
-    close(fd[1]); //WRITE END
-    _readCgi(fd[0]);
-    if (!_request.getBody().empty())
-        close(cgifd[0]);
-    close(fd[0]); //READ END
-    return;
 }
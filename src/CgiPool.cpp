@@ -0,0 +1,165 @@
+#include "../inc/CgiPool.hpp"
+
+std::map<std::string, CgiWorkerPool> CgiPool::_pools;
+
+// ================   Utils   ================ //
+/*
+python code a pooled interpreter runs:
+    - waits for the handoff on stdin (see CgiHandler::_acquireWorker())
+    - applies the resource limits, replaces the environment and runs the script as __main__
+      (compile() + exec(), runpy costs more than the scripts themselves)
+    - the rest of stdin is the request body, stdout goes to the server like for every cgi
+*/
+static const char *g_python_worker =
+    "import os,sys,resource\n"
+    "def read(n):\n"
+    "    b=b''\n"
+    "    while len(b)<n:\n"
+    "        c=os.read(0,n-len(b))\n"
+    "        if not c:\n"
+    "            os._exit(0)\n"
+    "        b+=c\n"
+    "    return b\n"
+    "f=read(int.from_bytes(read(4),'big')).split(b'\\0')\n"
+    "for r,v in zip((resource.RLIMIT_CPU,resource.RLIMIT_AS,resource.RLIMIT_NOFILE),f[:3]):\n"
+    "    if int(v):\n"
+    "        resource.setrlimit(r,(int(v),int(v)))\n"
+    "os.environ.clear()\n"
+    "for e in f[4:]:\n"
+    "    if e:\n"
+    "        k,_,v=e.partition(b'=')\n"
+    "        os.environb[k]=v\n"
+    "sys.argv=[f[3].decode()]\n"
+    "sys.path[0]=os.path.dirname(os.path.abspath(sys.argv[0]))\n"
+    "g={'__name__':'__main__','__file__':sys.argv[0],'__builtins__':__builtins__}\n"
+    "exec(compile(open(sys.argv[0],'rb').read(),sys.argv[0],'exec'),g)\n";
+
+// ======   Private member functions   ======= //
+/*
+starts a new interpreter, which waits for a handoff, and adds it to the idle workers of the pool
+*/
+bool CgiPool::_spawnWorker(const std::string &binary, CgiWorkerPool &pool)
+{
+    CgiWorker   worker;
+    char        *argv[4];
+    char        *env[1];
+
+    argv[0] = const_cast<char*>(binary.c_str());
+    argv[1] = const_cast<char*>("-c");
+    argv[2] = const_cast<char*>(g_python_worker);
+    argv[3] = NULL;
+    env[0] = NULL;
+    if ((worker._pid = CgiHandler::spawnProcess(argv, env, NULL, worker._in_fd, worker._out_fd)) == -1)
+        return false;
+    pool._idle.push_back(worker);
+    return true;
+}
+
+/*
+retires an idle worker: it exits when its stdin gets closed and is reaped by CgiHandler::reapOrphans()
+*/
+void CgiPool::_retireWorker(CgiWorker &worker)
+{
+    close(worker._in_fd);
+    close(worker._out_fd);
+    CgiHandler::addOrphan(worker._pid);
+}
+
+// =======   Static member functions   ======= //
+/*
+sets up the pools of pre-spawned interpreters of a configuration (binary -> min and max)
+    - min is the number of idle workers that are always kept, max the limit the pool grows to
+    - on a reload the limits get replaced, maintain() retires the idle workers beyond them,
+      the idle workers of a binary which has no pool anymore are retired right away
+*/
+void CgiPool::configure(const std::map<std::string, std::pair<size_t, size_t> > &pools)
+{
+    for (std::map<std::string, CgiWorkerPool>::iterator it = _pools.begin(); it != _pools.end(); )
+    {
+        if (pools.count(it->first))
+        {
+            it++;
+            continue ;
+        }
+        for (size_t i = 0; i < it->second._idle.size(); i++)
+            _retireWorker(it->second._idle[i]);
+        _pools.erase(it++);
+    }
+    for (std::map<std::string, std::pair<size_t, size_t> >::const_iterator it = pools.begin(); it != pools.end(); it++)
+    {
+        CgiWorkerPool &pool = _pools[it->first];
+
+        pool._min = it->second.first;
+        pool._max = it->second.second;
+        pool._target = std::min(std::max(pool._target, pool._min), pool._max);
+        pool._last_resize = time(NULL);
+    }
+}
+
+/*
+hands out an idle worker of the pool for the binary
+    - workers which died while waiting get skipped
+    - without an idle worker the pool grows by one (up to max) and false is returned
+*/
+bool CgiPool::acquire(const std::string &binary, pid_t &pid, int &in_fd, int &out_fd)
+{
+    std::map<std::string, CgiWorkerPool>::iterator it = _pools.find(binary);
+
+    if (it == _pools.end())
+        return false;
+
+    CgiWorkerPool &pool = it->second;
+
+    while (!pool._idle.empty())
+    {
+        CgiWorker worker = pool._idle.back();
+
+        pool._idle.pop_back();
+        if (waitpid(worker._pid, NULL, WNOHANG) != 0)
+        {
+            close(worker._in_fd);
+            close(worker._out_fd);
+            continue ;
+        }
+        pid = worker._pid;
+        in_fd = worker._in_fd;
+        out_fd = worker._out_fd;
+        return true;
+    }
+    if (pool._target < pool._max)
+        pool._target++;
+    pool._last_resize = time(NULL);
+    Logger::log(YELLOW, INFO, "CGI pool for %s has no idle worker, growing to %i", binary.c_str(), (int)pool._target);
+    return false;
+}
+
+/*
+keeps the number of idle workers of every pool at its target, called from the event loop:
+    - replaces handed out workers
+    - shrinks the target by one towards min every CGI_POOL_SHRINK_INTERVAL seconds without a miss
+*/
+void CgiPool::maintain()
+{
+    time_t now = time(NULL);
+
+    for (std::map<std::string, CgiWorkerPool>::iterator it = _pools.begin(); it != _pools.end(); it++)
+    {
+        CgiWorkerPool &pool = it->second;
+
+        if (pool._target > pool._min && now - pool._last_resize >= CGI_POOL_SHRINK_INTERVAL)
+        {
+            pool._target--;
+            pool._last_resize = now;
+        }
+        while (pool._idle.size() > pool._target)
+        {
+            _retireWorker(pool._idle.back());
+            pool._idle.pop_back();
+        }
+        while (pool._idle.size() < pool._target)
+        {
+            if (!_spawnWorker(it->first, pool))
+                break ;
+        }
+    }
+}
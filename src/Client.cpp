@@ -0,0 +1,36 @@
+#include "../inc/Client.hpp"
+
+// =============   Constructor   ============= //
+Client::Client()
+{
+    std::memset(&_client_address, 0, sizeof(_client_address));
+    _client_fd = -1;
+    _last_msg_time = 0;
+    socket = NULL;
+    request = NULL;
+    response = NULL;
+}
+
+// ===========   Copy Constructor   ========== //
+/*
+the copy gets an own request and response (a background client refreshing the cgi cache)
+*/
+Client::Client(const Client &rhs)
+{
+    _client_address = rhs._client_address;
+    _client_fd = rhs._client_fd;
+    _last_msg_time = rhs._last_msg_time;
+    socket = rhs.socket;
+    request = rhs.request ? new Request(*rhs.request) : NULL;
+    response = rhs.response ? new Response(*rhs.response) : NULL;
+}
+
+// ============   Deconstructor   ============ //
+/*
+the response goes first, its cgi still uses the configuration the request holds
+*/
+Client::~Client()
+{
+    delete response;
+    delete request;
+}
@@ -12,6 +12,12 @@ ConfigParser::~ConfigParser()
 {
 }
 
+// ===========   Exception class   =========== //
+const char  *ConfigParser::ConfigError::what() const throw()
+{
+    return "Config file misconfigured";
+}
+
 // ================   Utils   ================ //
 /*
 converts an string ip into an numeric ip address
@@ -65,19 +71,19 @@ static void handleRoot(std::string parameter, ServerBlock &server_block)
     if (parameter[parameter.size() - 1] != '/')
     {
         Logger::log(RED, ERROR, "Error: config file misconfigured: root directive: missing '/' at end");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     if (stat(parameter.c_str(), &buf) != 0)
     {
         Logger::log(RED, ERROR, "Error: Config file misconfigured: root directive: path invalid");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     if (S_ISDIR(buf.st_mode))
         server_block._root = parameter;
     else
     {
         Logger::log(RED, ERROR, "Config file misconfigured: root directive: is no directory");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
 }
 
@@ -115,7 +121,7 @@ static void handleListen(std::string parameter, ServerBlock &server_block)
         if (!isdigit(ip_str[i]) && ip_str[i] != '.')
         {
             Logger::log(RED, ERROR, "Config file misconfigured: listen directive: IP invalid");
-            exit(EXIT_FAILURE);
+            throw ConfigParser::ConfigError();
         }
     }
     try
@@ -125,7 +131,7 @@ static void handleListen(std::string parameter, ServerBlock &server_block)
     catch(const std::exception& e)
     {
         Logger::log(RED, ERROR, "Config file misconfigured: listen directive: IP invalid: %s", e.what());
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     server_block._host = host;
     server_block._ip = ip_str;
@@ -134,14 +140,14 @@ static void handleListen(std::string parameter, ServerBlock &server_block)
         if (!isdigit(port_str[i]))
         {
             Logger::log(RED, ERROR, "Config file misconfigured: listen directive: port invalid");
-            exit(EXIT_FAILURE);
+            throw ConfigParser::ConfigError();
         }
     }
     port = atoi(port_str.c_str());
     if (port < 1 || port > 65636)
     {
         Logger::log(RED, ERROR, "Config file misconfigured: listen directive: port invalid");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     server_block._port = port;
 }
@@ -173,7 +179,7 @@ static void handleServerNames(std::string parameter, ServerBlock &server_block)
             && (parameter[i] < '0' || parameter[i] > '9') && parameter[i] != '.' && parameter[i] != '-' && parameter[i] != '~' && parameter[i] != '_' )
         {
             Logger::log(RED, ERROR, "Config file misconfigured: server_name directive: invalid character");
-            exit(EXIT_FAILURE);
+            throw ConfigParser::ConfigError();
         }
         else
             name.push_back(parameter[i]);
@@ -194,13 +200,51 @@ static void handleClientMaxBodySize(std::string parameter, ServerBlock &server_b
         if (!isdigit(parameter[i]))
         {
             Logger::log(RED, ERROR, "Config file misconfigured: client_max_body_size directive: invalid character");
-            exit(EXIT_FAILURE);
+            throw ConfigParser::ConfigError();
         }
     }
     size = atoi(parameter.c_str());
     server_block._client_max_body_size = size;
 }
 
+/*
+parses an parameter string of the config and sets the client_body_buffer_size on the corresponding server_block:
+a request body growing beyond it is spooled to a temporary file instead of being kept in memory
+*/
+static void handleClientBodyBufferSize(std::string parameter, ServerBlock &server_block)
+{
+    for (size_t i = 0; i < parameter.length(); i ++)
+    {
+        if (!isdigit(parameter[i]))
+        {
+            Logger::log(RED, ERROR, "Config file misconfigured: client_body_buffer_size directive: invalid character");
+            throw ConfigParser::ConfigError();
+        }
+    }
+    server_block._client_body_buffer_size = strtoul(parameter.c_str(), NULL, 10);
+}
+
+/*
+parses an parameter string of the config and sets the directory for spooled request bodies on the corresponding server_block
+    - uploads get linked from there into the upload directory, so both should be on the same file system
+*/
+static void handleClientBodyTempPath(std::string parameter, ServerBlock &server_block)
+{
+    struct stat buf;
+
+    if (stat(parameter.c_str(), &buf) != 0 || !S_ISDIR(buf.st_mode))
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: client_body_temp_path directive: is no directory");
+        throw ConfigParser::ConfigError();
+    }
+    if (access(parameter.c_str(), W_OK))
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: client_body_temp_path directive: directory has no write rights");
+        throw ConfigParser::ConfigError();
+    }
+    server_block._client_body_temp_path = parameter;
+}
+
 /*
 parses an parameter string of the config and sets custom error pages on the corresponding server_block
 */
@@ -221,14 +265,14 @@ static void handleErrorPage(std::string parameter, ServerBlock &server_block)
         else
         {
             Logger::log(RED, ERROR, "Config file misconfigured: error_page directive: status code invalid");
-            exit(EXIT_FAILURE);
+            throw ConfigParser::ConfigError();
         }
     }
     status_code = atoi(status_code_str.c_str());
     if (i != 3 || status_code < 100 || status_code > 599)
     {
         Logger::log(RED, ERROR, "Config file misconfigured: error_page directive: status code invalid");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     for (; i < parameter.length(); i++)
     {
@@ -237,7 +281,7 @@ static void handleErrorPage(std::string parameter, ServerBlock &server_block)
             if (!isspace(parameter[i]))
             {
                 Logger::log(RED, ERROR, "Config file misconfigured: error_page directive: missing space");
-                exit(EXIT_FAILURE);
+                throw ConfigParser::ConfigError();
             }
         }
         else
@@ -247,12 +291,12 @@ static void handleErrorPage(std::string parameter, ServerBlock &server_block)
     if (stat(page_path.c_str(), &buf) != 0 || S_ISREG(buf.st_mode) == 0)
     {
         Logger::log(RED, ERROR, "Config file misconfigured: error_page directive: error page path invalid");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     if (access(page_path.c_str(), R_OK))
     {
         Logger::log(RED, ERROR, "Config file misconfigured: error_page directive: error page has no read rights");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     if (server_block._error_pages.count(status_code))
         server_block._error_pages.erase(status_code);
@@ -278,10 +322,12 @@ void handleAllowedMethods(std::string parameter, Location &location)
                 location._allowed_methods._allow_post = true;
             else if (method == "DELETE")
                 location._allowed_methods._allow_delete = true;
+            else if (method == "PUT")
+                location._allowed_methods._allow_put = true;
             else
             {
                 Logger::log(RED, ERROR, "Config file misconfigured: allowed_method directive: invalid method");
-                exit(EXIT_FAILURE);
+                throw ConfigParser::ConfigError();
             }
             while (parameter.length() && iswspace(parameter[i]))
                 i++;
@@ -311,26 +357,26 @@ static void handleAlias(std::string parameter, Location &location, ServerBlock &
     if (alias_path[alias_path.size() - 1] != '/')
     {
         Logger::log(RED, ERROR, "Error: config file misconfigured: alias directive: missing '/' at end");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     if (stat(alias_path.c_str(), &buf) != 0)
     {
         Logger::log(RED, ERROR, "Error: Config file misconfigured: alias directive: path invalid");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     if (S_ISDIR(buf.st_mode))
     {
         if (access(alias_path.c_str(), R_OK))
         {
             Logger::log(RED, ERROR, "Config file misconfigured: alias directive: directory has no read rights");
-            exit(EXIT_FAILURE);
+            throw ConfigParser::ConfigError();
         }
         location._alias = alias_path;
     }
     else
     {
         Logger::log(RED, ERROR, "Config file misconfigured: alias directive: is no directory");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
 }
 
@@ -347,7 +393,7 @@ static void handleAutoIndex(std::string parameter, Location &location)
     else
     {
         Logger::log(RED, ERROR, "Config file misconfigured: autoindex directive: invalid parameter (either 'on' or 'off')");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
 }
 
@@ -364,12 +410,12 @@ static void handleIndex(std::string parameter, Location &location, ServerBlock &
     if (stat(index.c_str(), &buf) != 0 || S_ISREG(buf.st_mode) == 0)
     {
         Logger::log(RED, ERROR, "Config file misconfigured: index directive: index file is invalid");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     if (access(index.c_str(), R_OK))
     {
         Logger::log(RED, ERROR, "Config file misconfigured: index directive: index file has no read rights");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     location._index = index;
 }
@@ -387,21 +433,42 @@ static void handleUpload(std::string parameter, Location &location, ServerBlock
     if (stat(upload_path.c_str(), &buf) != 0)
     {
         Logger::log(RED, ERROR, "Error: Config file misconfigured: upload directive: path invalid");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     if (S_ISDIR(buf.st_mode))
     { 
         if (access(upload_path.c_str(), W_OK))
         {
             Logger::log(RED, ERROR, "Config file misconfigured: upload directive: directory has no write rights");
-            exit(EXIT_FAILURE);
+            throw ConfigParser::ConfigError();
         }
         location._upload = upload_path;
     }  
     else
     {
         Logger::log(RED, ERROR, "Config file misconfigured: upload directive: is no directory");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
+    }
+}
+
+/*
+sets when uploads are flushed to the disk, before they are answered:
+    - off: never, the kernel writes them back on its own
+    - file: the file gets synced
+    - full: the file and the directory entry get synced
+*/
+static void handleUploadFsync(std::string parameter, Location &location)
+{
+    if (parameter == "off")
+        location._upload_fsync = FSYNC_OFF;
+    else if (parameter == "file")
+        location._upload_fsync = FSYNC_FILE;
+    else if (parameter == "full")
+        location._upload_fsync = FSYNC_FULL;
+    else
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: upload_fsync directive: invalid parameter (either 'off', 'file' or 'full')");
+        throw ConfigParser::ConfigError();
     }
 }
 
@@ -416,7 +483,7 @@ static void handleCgi(std::string parameter, Location &location)
     if (parameter[0] != '.')
     {
         Logger::log(RED, ERROR, "Config file misconfigured: cgi directive: expected '.' for the extension");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     while (i < parameter.size())
     {
@@ -428,7 +495,7 @@ static void handleCgi(std::string parameter, Location &location)
     if (!iswspace(parameter[i]))
     {
         Logger::log(RED, ERROR, "Config file misconfigured: cgi directive: missing space after extension");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     while (iswspace(parameter[i]))
         i++;
@@ -440,16 +507,218 @@ static void handleCgi(std::string parameter, Location &location)
     if (access(path.c_str(), F_OK))
     {
         Logger::log(RED, ERROR, "Config file misconfigured: cgi directive: can not find cgi at %s", path.c_str());
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     if (access(path.c_str(), X_OK))
     {
         Logger::log(RED, ERROR, "Config file misconfigured: cgi directive: can not execute cgi at %s", path.c_str());
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     location._cgi.insert(std::make_pair(extension, path));
 }
 
+/*
+parses the parameter of a directive which expects a positive number
+*/
+static size_t parseNumber(std::string parameter, const char *directive)
+{
+    if (parameter.empty())
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: %s directive: missing number", directive);
+        throw ConfigParser::ConfigError();
+    }
+    for (size_t i = 0; i < parameter.length(); i++)
+    {
+        if (!isdigit(parameter[i]))
+        {
+            Logger::log(RED, ERROR, "Config file misconfigured: %s directive: invalid character", directive);
+            throw ConfigParser::ConfigError();
+        }
+    }
+    return strtoul(parameter.c_str(), NULL, 10);
+}
+
+/*
+sets the time in seconds a cgi may run, before its process group gets killed
+*/
+static void handleCgiTimeout(std::string parameter, Location &location)
+{
+    location._cgi_timeout = parseNumber(parameter, "cgi_timeout");
+    if (location._cgi_timeout == 0)
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: cgi_timeout directive: timeout must be greater than 0");
+        throw ConfigParser::ConfigError();
+    }
+}
+
+/*
+sets the minimum and maximum number of idle pre-spawned interpreters for a cgi extension:
+    - "cgi_pool .py 2 8"
+*/
+static void handleCgiPool(std::string parameter, Location &location)
+{
+    std::istringstream  iss(parameter);
+    std::string         extension, min_str, max_str, rest;
+
+    iss >> extension >> min_str >> max_str;
+    if (extension.empty() || extension[0] != '.' || max_str.empty() || (iss >> rest))
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: cgi_pool directive: expected '.extension min max'");
+        throw ConfigParser::ConfigError();
+    }
+    size_t min = parseNumber(min_str, "cgi_pool");
+    size_t max = parseNumber(max_str, "cgi_pool");
+    if (max == 0 || min > max)
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: cgi_pool directive: min must not be greater than max and max not 0");
+        throw ConfigParser::ConfigError();
+    }
+    location._cgi_pool[extension] = std::make_pair(min, max);
+}
+
+/*
+sets the size of the queue for requests over cgi_max_concurrency, and optionally how many
+seconds a request may wait in it:
+    - "cgi_queue 16" or "cgi_queue 16 5"
+*/
+static void handleCgiQueue(std::string parameter, Location &location)
+{
+    std::istringstream  iss(parameter);
+    std::string         size_str, timeout_str, rest;
+
+    iss >> size_str >> timeout_str;
+    if (size_str.empty() || (iss >> rest))
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: cgi_queue directive: expected 'size [timeout]'");
+        throw ConfigParser::ConfigError();
+    }
+    location._cgi_queue_size = parseNumber(size_str, "cgi_queue");
+    if (timeout_str.empty())
+        return ;
+    location._cgi_queue_timeout = parseNumber(timeout_str, "cgi_queue");
+    if (location._cgi_queue_timeout == 0)
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: cgi_queue directive: timeout must be greater than 0");
+        throw ConfigParser::ConfigError();
+    }
+}
+
+/*
+enables the cache for cgi responses of the location:
+    - "cgi_cache 10" caches for 10 seconds, if the script does not send Cache-Control or Expires
+    - "cgi_cache 10 30" also serves the expired response for 30 more seconds, while it gets refreshed
+    - "cgi_cache 0" only caches responses the script sends a lifetime for
+*/
+static void handleCgiCache(std::string parameter, Location &location)
+{
+    std::istringstream  iss(parameter);
+    std::string         ttl_str, stale_str, rest;
+
+    iss >> ttl_str >> stale_str;
+    if (ttl_str.empty() || (iss >> rest))
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: cgi_cache directive: expected 'ttl [stale]'");
+        throw ConfigParser::ConfigError();
+    }
+    location._cgi_cache = true;
+    location._cgi_cache_ttl = parseNumber(ttl_str, "cgi_cache");
+    if (!stale_str.empty())
+        location._cgi_cache_stale = parseNumber(stale_str, "cgi_cache");
+}
+
+/*
+sets the request headers whose values are part of the cache key, next to method, host, path and query:
+    - "cgi_cache_key_headers Cookie Accept-Language"
+*/
+static void handleCgiCacheKeyHeaders(std::string parameter, Location &location)
+{
+    std::istringstream  iss(parameter);
+    std::string         header;
+
+    while (iss >> header)
+        location._cgi_cache_key_headers.push_back(header);
+    if (location._cgi_cache_key_headers.empty())
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: cgi_cache_key_headers directive: missing header");
+        throw ConfigParser::ConfigError();
+    }
+}
+
+/*
+turns coalescing of identical GET requests to the cgi of the location on or off
+*/
+static void handleCgiCoalesce(std::string parameter, Location &location)
+{
+    if (parameter == "off")
+        location._cgi_coalesce = false;
+    else if (parameter == "on")
+        location._cgi_coalesce = true;
+    else
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: cgi_coalesce directive: invalid parameter (either 'on' or 'off')");
+        throw ConfigParser::ConfigError();
+    }
+}
+
+/*
+turns streaming of the cgi output on or off: with 'on' the body is spliced to the client
+as it comes, instead of being collected until the cgi is finished
+*/
+static void handleCgiStream(std::string parameter, Location &location)
+{
+    if (parameter == "off")
+        location._cgi_stream = false;
+    else if (parameter == "on")
+        location._cgi_stream = true;
+    else
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: cgi_stream directive: invalid parameter (either 'on' or 'off')");
+        throw ConfigParser::ConfigError();
+    }
+}
+
+/*
+Checks the fastcgi_pass parameter and sets the address of the FastCGI server:
+ - either "unix:/path/to/socket"
+ - or "host:port"
+*/
+static void handleFastCgiPass(std::string parameter, Location &location)
+{
+    if (parameter.compare(0, 5, "unix:") == 0)
+    {
+        if (parameter.size() == 5 || parameter.size() - 5 >= sizeof(((struct sockaddr_un *)0)->sun_path))
+        {
+            Logger::log(RED, ERROR, "Config file misconfigured: fastcgi_pass directive: unix socket path invalid");
+            throw ConfigParser::ConfigError();
+        }
+        location._fastcgi_pass = parameter;
+        return ;
+    }
+    size_t colon = parameter.find(':');
+    if (colon == std::string::npos || colon == parameter.size() - 1)
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: fastcgi_pass directive: expected 'unix:/path' or 'host:port'");
+        throw ConfigParser::ConfigError();
+    }
+    std::string ip = parameter.substr(0, colon);
+    try
+    {
+        ipStringToNumeric(ip == "localhost" ? "127.0.0.1" : ip);
+    }
+    catch(const std::exception& e)
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: fastcgi_pass directive: IP invalid: %s", e.what());
+        throw ConfigParser::ConfigError();
+    }
+    size_t port = parseNumber(parameter.substr(colon + 1), "fastcgi_pass");
+    if (port < 1 || port > 65535)
+    {
+        Logger::log(RED, ERROR, "Config file misconfigured: fastcgi_pass directive: port invalid");
+        throw ConfigParser::ConfigError();
+    }
+    location._fastcgi_pass = parameter;
+}
+
 // ======   Private member functions   ======= //
 /*
 Tries to open the config file, reads it and saves its content inside the _content string.
@@ -466,19 +735,19 @@ void    ConfigParser::_readConfig(std::string config)
     if (config.size() < extension.size())
     {
         Logger::log(RED, ERROR, "Config must have '.conf' file extension: %s", config.c_str());
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     if (config.compare(config.size() - extension.size(), extension.size(), extension))
     {
         Logger::log(RED, ERROR, "Config must have '.conf' file extension: %s", config.c_str());
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
 
     // reads file
     if (file.fail())
     {
         Logger::log(RED, ERROR, "Unable to open file: %s", config.c_str());
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     buffer << file.rdbuf();
     file.close();
@@ -535,14 +804,14 @@ void    ConfigParser::_findNextServerBlock()
             else
             {
                 Logger::log(RED, ERROR, "Config file misconfigured: missing '{'");
-                exit(EXIT_FAILURE);
+                throw ConfigParser::ConfigError();
             }
         }
         else
         {
             // std::cout << _content[_i];
             Logger::log(RED, ERROR, "Config file misconfigured: found something else than server block");
-            exit(EXIT_FAILURE);
+            throw ConfigParser::ConfigError();
         }
     }
 }
@@ -566,7 +835,7 @@ std::string ConfigParser::_getParameter()
             if (iswspace(_content[_i - 1]))
             {
                 Logger::log(RED, ERROR, "Config file misconfigured: invalid syntax: found whitespace before ';'");
-                exit(EXIT_FAILURE);
+                throw ConfigParser::ConfigError();
             }
             _i++;
             found = true;
@@ -578,7 +847,7 @@ std::string ConfigParser::_getParameter()
     if (!found)
     {
         Logger::log(RED, ERROR, "Config file misconfigured: missing ';'");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     parameter = _content.substr(start, _i - start - 1);
     return parameter;
@@ -594,6 +863,8 @@ Directive ConfigParser::_getDirectiveType()
     map["listen"] = LISTEN;
     map["server_name"] = SERVER_NAME;
     map["client_max_body_size"] = CLIENT_MAX_BODY_SIZE;
+    map["client_body_buffer_size"] = CLIENT_BODY_BUFFER_SIZE;
+    map["client_body_temp_path"] = CLIENT_BODY_TEMP_PATH;
     map["error_page"] = ERROR_PAGE;
     map["allowed_methods"] = ALLOWED_METHODS;
     map["return"] = REDIRECTION;
@@ -602,19 +873,30 @@ Directive ConfigParser::_getDirectiveType()
     map["index"] = INDEX;
     map["location"] = LOCATION;
     map["upload"] = UPLOAD;
+    map["upload_fsync"] = UPLOAD_FSYNC;
     map["cgi"] = CGI;
+    map["cgi_timeout"] = CGI_TIMEOUT;
+    map["cgi_pool"] = CGI_POOL;
+    map["cgi_limit_cpu"] = CGI_LIMIT_CPU;
+    map["cgi_limit_as"] = CGI_LIMIT_AS;
+    map["cgi_limit_nofile"] = CGI_LIMIT_NOFILE;
+    map["cgi_max_concurrency"] = CGI_MAX_CONCURRENCY;
+    map["cgi_queue"] = CGI_QUEUE;
+    map["cgi_cache"] = CGI_CACHE;
+    map["cgi_cache_key_headers"] = CGI_CACHE_KEY_HEADERS;
+    map["cgi_coalesce"] = CGI_COALESCE;
+    map["cgi_stream"] = CGI_STREAM;
+    map["fastcgi_pass"] = FASTCGI_PASS;
     for (std::map<std::string, Directive>::const_iterator it = map.begin(); it != map.end(); it++)
     {
         const std::string&  keyword = it->first;
         Directive           type = it->second;
 
-        if (_content.compare(_i, keyword.length(), keyword) == 0)
+        // a keyword can be the prefix of another one ("cgi" and "cgi_timeout")
+        if (_content.compare(_i, keyword.length(), keyword) == 0 && _content[_i + keyword.length()] == ' ')
         {
             _i += keyword.length();
-            if (_content[_i] == ' ')
-                return type;
-            else
-                break ;
+            return type;
         }
     }
     return UNKNOWN;
@@ -650,12 +932,26 @@ void    ConfigParser::_getLocation(ServerBlock &server_block)
 
     std::memset(&location._allowed_methods, 0, sizeof(AllowedMethods));
     std::memset(&location._autoindex, 0, sizeof(bool));
+    location._cgi_timeout = DEFAULT_CGI_TIMEOUT;
+    location._cgi_limit_cpu = 0;
+    location._cgi_limit_as = 0;
+    location._cgi_limit_nofile = 0;
+    location._cgi_max_concurrency = 0;
+    location._cgi_queue_size = 0;
+    location._cgi_queue_timeout = DEFAULT_CGI_QUEUE_TIMEOUT;
+    location._cgi_queue_id = 0;
+    location._cgi_cache = false;
+    location._cgi_cache_ttl = 0;
+    location._cgi_cache_stale = 0;
+    location._cgi_coalesce = false;
+    location._cgi_stream = false;
+    location._upload_fsync = FSYNC_OFF;
     path = _getLocationPath();
     _skipWhiteSpaces();
     if (_content[_i] != '{')
     {
         Logger::log(RED, ERROR, "Config file misconfigured: missing '{'");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     _i++;
     for (; _i < _content.length(); _i++)
@@ -687,18 +983,57 @@ void    ConfigParser::_getLocation(ServerBlock &server_block)
         case UPLOAD:
             handleUpload(parameter, location, server_block);
             break;
+        case UPLOAD_FSYNC:
+            handleUploadFsync(parameter, location);
+            break;
         case CGI:
             handleCgi(parameter, location);
             break;
+        case CGI_TIMEOUT:
+            handleCgiTimeout(parameter, location);
+            break;
+        case CGI_POOL:
+            handleCgiPool(parameter, location);
+            break;
+        case CGI_LIMIT_CPU:
+            location._cgi_limit_cpu = parseNumber(parameter, "cgi_limit_cpu");
+            break;
+        case CGI_LIMIT_AS:
+            location._cgi_limit_as = parseNumber(parameter, "cgi_limit_as");
+            break;
+        case CGI_LIMIT_NOFILE:
+            location._cgi_limit_nofile = parseNumber(parameter, "cgi_limit_nofile");
+            break;
+        case CGI_MAX_CONCURRENCY:
+            location._cgi_max_concurrency = parseNumber(parameter, "cgi_max_concurrency");
+            break;
+        case CGI_QUEUE:
+            handleCgiQueue(parameter, location);
+            break;
+        case CGI_CACHE:
+            handleCgiCache(parameter, location);
+            break;
+        case CGI_CACHE_KEY_HEADERS:
+            handleCgiCacheKeyHeaders(parameter, location);
+            break;
+        case CGI_COALESCE:
+            handleCgiCoalesce(parameter, location);
+            break;
+        case CGI_STREAM:
+            handleCgiStream(parameter, location);
+            break;
+        case FASTCGI_PASS:
+            handleFastCgiPass(parameter, location);
+            break;
         default:
             Logger::log(RED, ERROR, "Config file misconfigured: invalid directive in location");
-            exit(EXIT_FAILURE);
+            throw ConfigParser::ConfigError();
         }
     }
     if (_content[_i] != '}')
     {
         Logger::log(RED, ERROR, "Config file misconfigured: missing '}'");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     _i++;
     if (not_empty)
@@ -732,6 +1067,12 @@ void    ConfigParser::_getDirective(ServerBlock &server_block)
     case CLIENT_MAX_BODY_SIZE:
         handleClientMaxBodySize(parameter, server_block);
         break;
+    case CLIENT_BODY_BUFFER_SIZE:
+        handleClientBodyBufferSize(parameter, server_block);
+        break;
+    case CLIENT_BODY_TEMP_PATH:
+        handleClientBodyTempPath(parameter, server_block);
+        break;
     case ERROR_PAGE:
         handleErrorPage(parameter, server_block);
         break;
@@ -740,7 +1081,7 @@ void    ConfigParser::_getDirective(ServerBlock &server_block)
         break;
     default:
         Logger::log(RED, ERROR, "Config file misconfigured: invalid directive in server block");
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
 }
 
@@ -757,22 +1098,21 @@ void    ConfigParser::_setDefaultValues(ServerBlock &server_block)
     catch(const std::exception& e)
     {
         Logger::log(RED, ERROR, "Webserv header misconfigured: DEFAULT_HOST: ip invalid: %s", e.what());
-        exit(EXIT_FAILURE);
+        throw ConfigParser::ConfigError();
     }
     server_block._port = DEFAULT_PORT;
     server_block._root = DEFAULT_ROOT;
+    server_block._root_fd = -1;
     server_block._client_max_body_size = DEFAULT_CLIENT_MAX_BODY_SIZE;
+    server_block._client_body_buffer_size = DEFAULT_CLIENT_BODY_BUFFER_SIZE;
     server_block._socket = NULL;
 }
 
-// ==========   Member functions   =========== //
 /*
-Parses the config file and adds every server block with the corresponding settings to the _server_blocks vector
+Parses the _content string and adds every server block with the corresponding settings to the _server_blocks vector
 */
-void    ConfigParser::parse(std::string config)
+void    ConfigParser::_parseServerBlocks()
 {
-    _readConfig(config);
-
     for (; _i < _content.length();)
     {
         ServerBlock server_block;
@@ -789,10 +1129,36 @@ void    ConfigParser::parse(std::string config)
         if (_content[_i] != '}')
         {
             Logger::log(RED, ERROR, "Config file misconfigured: missing '}'");
-            exit(EXIT_FAILURE);
+            throw ConfigParser::ConfigError();
         }
         _i++;
+        // files are served relative to the root directory (see openBelowRoot())
+        if ((server_block._root_fd = open(server_block._root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        {
+            Logger::log(RED, ERROR, "Config file misconfigured: root directive: %s", strerror(errno));
+            throw ConfigParser::ConfigError();
+        }
         _server_blocks.push_back(server_block);
         _skipWhiteSpaces();
     }
 }
+
+// ==========   Member functions   =========== //
+/*
+Parses the config file and adds every server block with the corresponding settings to the _server_blocks vector
+*/
+void    ConfigParser::parse(std::string config)
+{
+    _readConfig(config);
+    _parseServerBlocks();
+}
+
+/*
+Parses the content of a config file which is already read into memory
+*/
+void    ConfigParser::parseContent(const std::string &content)
+{
+    _content = content;
+    _i = 0;
+    _parseServerBlocks();
+}
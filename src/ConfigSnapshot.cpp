@@ -0,0 +1,55 @@
+#include "../inc/ConfigSnapshot.hpp"
+
+// =============   Constructor   ============= //
+/*
+takes the server blocks over (they are swapped in, not copied), the creator holds the first reference
+*/
+ConfigSnapshot::ConfigSnapshot(std::vector<ServerBlock> &server_blocks, size_t generation)
+{
+    _server_blocks.swap(server_blocks);
+    _generation = generation;
+    _refs = 1;
+}
+
+// ============   Deconstructor   ============ //
+ConfigSnapshot::~ConfigSnapshot()
+{
+    for (size_t i = 0; i < _server_blocks.size(); i++)
+    {
+        if (_server_blocks[i]._root_fd >= 0)
+            close(_server_blocks[i]._root_fd);
+    }
+}
+
+// ==============   Getters   ================ //
+const std::vector<ServerBlock> &ConfigSnapshot::getServerBlocks() const
+{
+    return _server_blocks;
+}
+
+size_t ConfigSnapshot::getGeneration() const
+{
+    return _generation;
+}
+
+// ==========   Member functions   =========== //
+/*
+adds a reference, returns the snapshot for convenience
+*/
+ConfigSnapshot *ConfigSnapshot::acquire()
+{
+    _refs++;
+    return this;
+}
+
+/*
+drops a reference, the last one deletes the snapshot
+*/
+void ConfigSnapshot::release()
+{
+    if (--_refs == 0)
+    {
+        Logger::log(GREY, DEBUG, "Released configuration generation[%lu]", _generation);
+        delete this;
+    }
+}
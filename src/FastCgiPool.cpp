@@ -0,0 +1,101 @@
+#include "../inc/FastCgiPool.hpp"
+
+std::map<std::string, std::vector<int> > FastCgiPool::_idle;
+
+// ======   Private member functions   ======= //
+/*
+opens a new non-blocking connection to a FastCGI server
+    - the address is either "unix:/path/to/socket" or "host:port"
+    - the connect may still be in progress, a failure shows up on the first write
+    - on error, -1 is returned, and errno is set to indicate the error.
+*/
+int FastCgiPool::_connect(const std::string &address)
+{
+    int fd;
+    int ret;
+
+    if (address.compare(0, 5, "unix:") == 0)
+    {
+        struct sockaddr_un  addr;
+        std::string         path = address.substr(5);
+
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+            return -1;
+        ret = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+    else
+    {
+        struct sockaddr_in  addr;
+        size_t              colon = address.find(':');
+        std::string         ip = address.substr(0, colon);
+
+        if (ip == "localhost")
+            ip = "127.0.0.1";
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(address.substr(colon + 1).c_str()));
+        addr.sin_addr.s_addr = htonl(ipStringToNumeric(ip));
+        if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+            return -1;
+        ret = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+    if (ret < 0 && errno != EINPROGRESS)
+    {
+        close(fd);
+        return -1;
+    }
+    Logger::log(GREY, DEBUG, "Opened new FastCGI connection fd[%i] to %s", fd, address.c_str());
+    return fd;
+}
+
+// =======   Static member functions   ======= //
+/*
+returns a connection to the FastCGI server:
+    - reuses an idle keep-alive connection, if the server did not close it in the meantime
+    - opens a new connection otherwise
+    - on error, -1 is returned
+*/
+int FastCgiPool::acquire(const std::string &address)
+{
+    std::vector<int>    &idle = _idle[address];
+    char                c;
+
+    while (!idle.empty())
+    {
+        int fd = idle.back();
+
+        idle.pop_back();
+        // an idle connection has nothing to read, anything else means it got closed
+        if (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && errno == EAGAIN)
+            return fd;
+        close(fd);
+    }
+    try
+    {
+        return _connect(address);
+    }
+    catch(const std::exception& e)
+    {
+        Logger::log(RED, ERROR, "FastCGI address invalid: %s", e.what());
+        return -1;
+    }
+}
+
+/*
+gives a connection with a finished request back to the pool of idle connections
+    - closes it, if there are allready FASTCGI_MAX_IDLE_CONNECTIONS for the address
+*/
+void FastCgiPool::release(const std::string &address, int fd)
+{
+    std::vector<int>    &idle = _idle[address];
+
+    if (idle.size() >= FASTCGI_MAX_IDLE_CONNECTIONS)
+    {
+        close(fd);
+        return ;
+    }
+    idle.push_back(fd);
+}
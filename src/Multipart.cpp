@@ -0,0 +1,287 @@
+#include "../inc/Multipart.hpp"
+
+// =============   Constructor   ============= //
+/*
+prepares the search for the delimiter "\r\n--boundary":
+    - the buffer starts with "\r\n", so a body starting right with the first boundary
+      (which has no line break in front of it) is found the same way
+    - skip table of the Boyer-Moore-Horspool search: how far the window can move,
+      if a byte is below its last position
+*/
+Multipart::Multipart(const std::string &boundary, const std::string &upload_dir, UploadFsync sync)
+{
+    _state = MULTIPART_PREAMBLE;
+    _error = OK;
+    _delimiter = "\r\n--" + boundary;
+    _buffer = "\r\n";
+    _upload_dir = upload_dir;
+    _fd = -1;
+    _sync = sync;
+    _files = 0;
+    _created = false;
+    for (size_t i = 0; i < 256; i++)
+        _skip[i] = _delimiter.size();
+    for (size_t i = 0; i + 1 < _delimiter.size(); i++)
+        _skip[(unsigned char)_delimiter[i]] = _delimiter.size() - 1 - i;
+}
+
+// ============   Deconstructor   ============ //
+/*
+a part which is still open did not arrive completely, its file gets removed
+*/
+Multipart::~Multipart()
+{
+    if (_fd >= 0)
+    {
+        close(_fd);
+        unlink(_path.c_str());
+    }
+}
+
+// ================   Utils   ================ //
+/*
+returns the value of the parameter name (e.g. filename="a.txt") in a header value, or "" if there is none
+*/
+static std::string  getParameter(const std::string &value, const std::string &name)
+{
+    size_t pos = 0;
+
+    while ((pos = value.find(name + "=", pos)) != std::string::npos)
+    {
+        if (pos == 0 || value[pos - 1] == ';' || value[pos - 1] == ' ' || value[pos - 1] == '\t')
+            break ;
+        pos += name.size();
+    }
+    if (pos == std::string::npos)
+        return "";
+    pos += name.size() + 1;
+    if (pos < value.size() && value[pos] == '"')
+        return value.substr(pos + 1, value.find('"', pos + 1) - pos - 1);
+    return value.substr(pos, value.find_first_of("; \t", pos) - pos);
+}
+
+// ======   Private member functions   ======= //
+/*
+Boyer-Moore-Horspool search for the delimiter in data:
+    - compares the last byte of the window first and skips ahead by the skip table,
+      so with a long boundary most bytes of the body are never looked at
+    - returns the offset of the delimiter or std::string::npos
+*/
+size_t Multipart::_search(const char *data, size_t len) const
+{
+    const size_t        last = _delimiter.size() - 1;
+    const unsigned char end = _delimiter[last];
+    size_t              pos = 0;
+
+    while (pos + last < len)
+    {
+        unsigned char c = data[pos + last];
+
+        if (c == end && memcmp(data + pos, _delimiter.data(), last) == 0)
+            return pos;
+        pos += _skip[c];
+    }
+    return std::string::npos;
+}
+
+/*
+runs the state machine over the buffered bytes and removes the processed ones:
+    - content is written up to the bytes which could be the start of a delimiter,
+      so the buffer never holds more than one chunk and the delimiter
+    - after a delimiter either "--" (the end) or the header block of the next part follows
+*/
+void Multipart::_process()
+{
+    size_t i = 0;
+    size_t pos;
+
+    while (i < _buffer.size())
+    {
+        if (_state == MULTIPART_PREAMBLE || _state == MULTIPART_CONTENT)
+        {
+            pos = _search(_buffer.data() + i, _buffer.size() - i);
+            if (pos == std::string::npos)
+            {
+                pos = _buffer.size() - i < _delimiter.size() ? 0 : _buffer.size() - i - _delimiter.size() + 1;
+                if (_state == MULTIPART_CONTENT && !_writePart(_buffer.data() + i, pos))
+                    return ;
+                i += pos;
+                break ;
+            }
+            if (_state == MULTIPART_CONTENT && (!_writePart(_buffer.data() + i, pos) || !_closePart()))
+                return ;
+            i += pos + _delimiter.size();
+            _state = MULTIPART_BOUNDARY;
+        }
+        else if (_state == MULTIPART_BOUNDARY)
+        {
+            if (_buffer.size() - i < 2)
+                break ;
+            if (_buffer.compare(i, 2, "--") == 0)
+                _state = MULTIPART_EPILOGUE;
+            else if (_buffer.compare(i, 2, "\r\n") == 0)
+                _state = MULTIPART_HEADERS;
+            else
+                return _fail(BAD_REQUEST);
+        }
+        else if (_state == MULTIPART_HEADERS)
+        {
+            // i is at the line break after the boundary, an empty header block is "\r\n\r\n" as well
+            pos = _buffer.find("\r\n\r\n", i);
+            if (pos == std::string::npos)
+            {
+                if (_buffer.size() - i > MULTIPART_MAX_HEADER_LENGTH)
+                    return _fail(BAD_REQUEST);
+                break ;
+            }
+            if (!_openPart(_buffer.substr(i + 2, pos - i)))
+                return ;
+            i = pos + 4;
+            _state = MULTIPART_CONTENT;
+        }
+        else
+            i = _buffer.size();
+    }
+    _buffer.erase(0, i);
+}
+
+/*
+opens the file for a part with a filename in its Content-Disposition in the upload directory:
+    - only the last path component of the filename is used
+    - parts without a filename (form fields) are skipped
+    - returns false on error
+*/
+bool Multipart::_openPart(const std::string &headers)
+{
+    std::istringstream  iss(headers);
+    std::string         line;
+    std::string         filename;
+
+    while (std::getline(iss, line))
+    {
+        if (strncasecmp(line.c_str(), "Content-Disposition:", 20) == 0)
+            filename = getParameter(line.substr(20, line.find_last_not_of("\r") - 19), "filename");
+    }
+    filename = filename.substr(filename.find_last_of("/\\") + 1);
+    if (filename.empty())
+        return true;
+    if (filename == "." || filename == "..")
+    {
+        _fail(BAD_REQUEST);
+        return false;
+    }
+    _path = _upload_dir + "/" + filename;
+    if (access(_path.c_str(), F_OK) != 0)
+        _created = true;
+    if ((_fd = open(_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0)
+    {
+        Logger::log(RED, ERROR, "Opening %s for the upload failed: %s", _path.c_str(), strerror(errno));
+        _fail(INTERNAL_SERVER_ERROR);
+        return false;
+    }
+    _files++;
+    return true;
+}
+
+/*
+writes content of the current part into its file (nothing for a part without file), returns false on error
+*/
+bool Multipart::_writePart(const char *data, size_t len)
+{
+    ssize_t bytes;
+
+    while (_fd >= 0 && len > 0)
+    {
+        if ((bytes = write(_fd, data, len)) < 0)
+        {
+            Logger::log(RED, ERROR, "Writing the upload to %s failed: %s", _path.c_str(), strerror(errno));
+            _fail(INTERNAL_SERVER_ERROR);
+            return false;
+        }
+        data += bytes;
+        len -= bytes;
+    }
+    return true;
+}
+
+/*
+closes the file of a complete part, synced to the disk if upload_fsync says so, returns false on error
+*/
+bool Multipart::_closePart()
+{
+    if (_fd < 0)
+        return true;
+    if (_sync != FSYNC_OFF && fsync(_fd) != 0)
+    {
+        Logger::log(RED, ERROR, "Syncing the upload %s failed: %s", _path.c_str(), strerror(errno));
+        _fail(INTERNAL_SERVER_ERROR);
+        return false;
+    }
+    close(_fd);
+    _fd = -1;
+    return true;
+}
+
+/*
+stops the parsing, the rest of the body gets ignored and the upload is answered with the error
+*/
+void Multipart::_fail(int error)
+{
+    if (_error == OK)
+        _error = error;
+    _state = MULTIPART_EPILOGUE;
+    _buffer.clear();
+}
+
+// ======   Public member functions   ======= //
+/*
+parses the next bytes of the body, they can be cut anywhere
+    - the bytes are processed in slices of MULTIPART_CHUNK_SIZE, so the memory
+      stays the same for a body passed in at once
+*/
+void Multipart::feed(const char *data, size_t len)
+{
+    while (len > 0 && _state != MULTIPART_EPILOGUE)
+    {
+        size_t n = std::min(len, (size_t)MULTIPART_CHUNK_SIZE);
+
+        _buffer.append(data, n);
+        _process();
+        data += n;
+        len -= n;
+    }
+}
+
+/*
+to be called once the body is complete, returns the status of the upload:
+    - CREATED if a new file was created, NO_CONTENT if all files existed already
+    - BAD_REQUEST for a body which ended before the last boundary or held no file
+*/
+int Multipart::finish()
+{
+    if (_error == OK && _state != MULTIPART_EPILOGUE)
+        _error = BAD_REQUEST;
+    if (_error == OK && _files == 0)
+        _error = BAD_REQUEST;
+    if (_error == OK && _sync == FSYNC_FULL && !syncDirectory(_upload_dir + "/"))
+        _error = INTERNAL_SERVER_ERROR;
+    if (_error != OK)
+        return _error;
+    return _created ? CREATED : NO_CONTENT;
+}
+
+// =======   Static member functions   ======= //
+/*
+returns the boundary of a multipart/form-data Content-Type, or "" if it has none or an invalid one
+*/
+std::string Multipart::getBoundary(const std::string &content_type)
+{
+    std::string boundary;
+
+    if (content_type.find("multipart/form-data") == std::string::npos)
+        return "";
+    boundary = getParameter(content_type, "boundary");
+    if (boundary.size() > 70)
+        return "";
+    return boundary;
+}
@@ -3,37 +3,68 @@
 // =============   Constructor   ============= //
 Request::Request()
 {
+    _body_fd = -1;
+    _inflate = NULL;
+    _raw = NULL;
+    _raw_size = 0;
+    _config = NULL;
     clear();
     _socket = NULL;
 }
 
 // ===========   Copy Constructor   ========== //
-Request::Request(const Request &rhs) : _ss(rhs._ss.str())
+/*
+the copy holds a reference to the same configuration
+    - a body spilled into a memfd is owned by exactly one request and is not copied,
+      neither is the state of its decompression
+    - the copy lends an own buffer for the head out of the buffer pool
+*/
+Request::Request(const Request &rhs)
 {
     if (this != &rhs)
 	{
 		_state = rhs._state;
         _error = rhs._error;
         _method = rhs._method;
+        _raw = NULL;
+        _raw_len = 0;
+        _raw_size = 0;
+        if (rhs._raw_len > 0 && _lendRaw(rhs._raw_len))
+        {
+            std::memcpy(_raw, rhs._raw, rhs._raw_len);
+            _raw_len = rhs._raw_len;
+        }
         _path = rhs._path;
-        _query = rhs._query;
-        _fragment = rhs._fragment;
+        _path_start = rhs._path_start;
+        _query_start = rhs._query_start;
+        _query_len = rhs._query_len;
+        _fragment_start = rhs._fragment_start;
+        _fragment_len = rhs._fragment_len;
         _version_major = rhs._version_major;
         _version_minor = rhs._version_minor;
-        _headers = rhs._headers;
+        for (int id = 0; id < HEADER_OTHER; id++)
+            _known[id] = rhs._known[id];
+        _repeated = rhs._repeated;
+        _fields = rhs._fields;
+        _field = rhs._field;
+        _keep_alive = rhs._keep_alive;
+        _close = rhs._close;
         _body = rhs._body;
         _method_str = rhs._method_str;
-        _header_field_name = rhs._header_field_name;
-        _header_field_value = rhs._header_field_value;
-        _chunk_length_str = rhs._chunk_length_str;
+        _chunk_digits = rhs._chunk_digits;
         _uri_len = rhs._uri_len;
         _header_len = rhs._header_len;
         _body_len = rhs._body_len;
         _chunk_len = rhs._chunk_len;
+        _content_length = rhs._content_length;
+        _body_fd = -1;
         _body_flag = rhs._body_flag;
         _chunked_transfer_flag = rhs._chunked_transfer_flag;
+        _expect_continue = rhs._expect_continue;
+        _body_encoded = rhs._body_encoded;
+        _inflate = NULL;
         _client_max_body_size = rhs._client_max_body_size;
-        _server_blocks = rhs._server_blocks;
+        _config = rhs._config != NULL ? rhs._config->acquire() : NULL;
         _server = rhs._server;
         _socket = rhs._socket;
 	}
@@ -43,15 +74,28 @@ Request::Request(const Request &rhs) : _ss(rhs._ss.str())
 // ============   Deconstructor   ============ //
 Request::~Request()
 {
+    if (_body_fd >= 0)
+        close(_body_fd);
+    _endDecoding();
+    BufferPool::release(_raw, _raw_size);
+    if (_config != NULL)
+        _config->release();
 }
 
 // ==============   Setters   ================ //
-void    Request::setServerBlocks(std::vector<ServerBlock> &server_blocks)
+/*
+the request holds a reference to the configuration it is served with, until clear()
+*/
+void    Request::setConfig(ConfigSnapshot *config)
 {
-    _server_blocks = server_blocks;
+    ConfigSnapshot  *previous = _config;
+
+    _config = config->acquire();
+    if (previous != NULL)
+        previous->release();
 }
 
-void    Request::setServerBlock(ServerBlock *server_block)
+void    Request::setServerBlock(const ServerBlock *server_block)
 {
     _server = server_block;
 }
@@ -61,6 +105,14 @@ void    Request::setSocket(Socket *socket)
     _socket = socket;
 }
 
+/*
+rejects the request before its body arrived, the rest of it is not parsed anymore
+*/
+void    Request::setError(int error)
+{
+    _error = error;
+}
+
 // ==============   Getters   ================ //
 int Request::getError() const
 {
@@ -86,7 +138,12 @@ ParsingState    Request::getParsingState() const
     return _state;
 }
 
-ServerBlock*  Request::getServerBlock() const
+ConfigSnapshot* Request::getConfig() const
+{
+    return _config;
+}
+
+const ServerBlock*  Request::getServerBlock() const
 {
     return _server;
 }
@@ -106,14 +163,14 @@ const std::string   &Request::getPath() const
     return _path;
 }
 
-const std::string   &Request::getQuery() const
+std::string Request::getQuery() const
 {
-    return _query;
+    return std::string(_raw + _query_start, _query_len);
 }
 
-const std::string   &Request::getFragment() const
+std::string Request::getFragment() const
 {
-    return _fragment;
+    return std::string(_raw + _fragment_start, _fragment_len);
 }
 
 const std::string   &Request::getBody() const
@@ -121,9 +178,119 @@ const std::string   &Request::getBody() const
     return _body;
 }
 
-const std::map<std::string, std::string>    &Request::getHeaders() const
+/*
+the length of the body: from Content-Length, or what arrived of a chunked body so far
+*/
+size_t  Request::getContentLength() const
+{
+    return _content_length;
+}
+
+/*
+the number of bytes of a body with Content-Length which did not arrive yet
+*/
+size_t  Request::getRemainingBody() const
+{
+    return _state == Message_Body ? _body_len : 0;
+}
+
+/*
+the file holding a spilled body (see spillBody()), or -1
+*/
+int Request::getBodyFd() const
+{
+    return _body_fd;
+}
+
+/*
+all header fields as strings, a field appearing more than once is combined into one
+    - a known field is named as in its first line, other fields are combined if their names match
+*/
+std::map<std::string, std::string>  Request::getHeaders() const
+{
+    std::map<std::string, std::string>  headers;
+
+    for (int id = 0; id < HEADER_OTHER; id++)
+    {
+        if (hasHeader(static_cast<KnownHeader>(id)))
+            headers[std::string(_raw + _known[id]._name, _known[id]._name_len)] = getHeader(static_cast<KnownHeader>(id));
+    }
+    for (size_t i = 0; i < _fields.size(); i++)
+    {
+        if (_fields[i]._id != HEADER_OTHER)
+            continue ;
+
+        std::string name(_raw + _fields[i]._name, _fields[i]._name_len);
+
+        if (headers.count(name))
+            headers[name] += ", ";
+        headers[name].append(_raw + _fields[i]._value, _fields[i]._value_len);
+    }
+    return headers;
+}
+
+/*
+the value of a known header field (combined if it appears more than once), or "" if there is none
+*/
+std::string Request::getHeader(KnownHeader id) const
 {
-    return _headers;
+    std::string value;
+
+    if (!hasHeader(id))
+        return value;
+    value.assign(_raw + _known[id]._value, _known[id]._value_len);
+    if ((_repeated & (1u << id)) == 0)
+        return value;
+    for (size_t i = 0; i < _fields.size(); i++)
+    {
+        if (_fields[i]._id == id)
+            value.append(", ").append(_raw + _fields[i]._value, _fields[i]._value_len);
+    }
+    return value;
+}
+
+/*
+the value of a header field by its name (case-insensitive), or "" if there is none
+*/
+std::string Request::getHeader(const char *name) const
+{
+    size_t      len = strlen(name);
+    KnownHeader id = lookupHeader(name, len);
+    std::string value;
+    bool        found = false;
+
+    if (id != HEADER_OTHER)
+        return getHeader(id);
+    for (size_t i = 0; i < _fields.size(); i++)
+    {
+        if (_fields[i]._name_len != len || strncasecmp(_raw + _fields[i]._name, name, len) != 0)
+            continue ;
+        if (found)
+            value += ", ";
+        value.append(_raw + _fields[i]._value, _fields[i]._value_len);
+        found = true;
+    }
+    return value;
+}
+
+bool    Request::hasHeader(KnownHeader id) const
+{
+    return _known[id]._name_len > 0;
+}
+
+bool    Request::hasHeader(const char *name) const
+{
+    size_t      len = strlen(name);
+    KnownHeader id = lookupHeader(name, len);
+
+    if (id != HEADER_OTHER)
+        return hasHeader(id);
+    for (size_t i = 0; i < _fields.size(); i++)
+    {
+        if (_fields[i]._name_len == len && strncasecmp(_raw + _fields[i]._name, name, len) == 0)
+            return true;
+    }
+    return false;
 }
 
 // ================   Utils   ================ //
@@ -167,111 +334,475 @@ static bool    allowedFieldValueChar(uint8_t c)
 }
 
 /*
-Checks and returns true if the URI path goes under the root directory
+lookup tables of the characters a run in the fast path may consist of, built from the checks above:
+    - uri: allowed URI characters without '?' and '#', which end the path or the query
+    - name: token characters, ':' ends the field name
+    - value: field value characters, CR ends the field value
+    - hex: the value of a hex digit of a chunk size, -1 for other characters
 */
-static bool    checkPathUnderRoot(std::string path)
+struct ScanTables
 {
-    char    *directory = strtok((char*)path.c_str(), "/");
-    int     pos = 0;
- 
-    while (directory != NULL)
+    bool        uri[256];
+    bool        name[256];
+    bool        value[256];
+    signed char hex[256];
+
+    ScanTables()
     {
-        if (!strcmp(directory, ".."))
-            pos--;
-        else
-            pos++;
-        if (pos < 0)
-            return true;
-        directory = strtok(NULL, "/");
+        for (int c = 0; c < 256; c++)
+        {
+            uri[c] = allowedURIChar(c) && c != '?' && c != '#';
+            name[c] = allowedFieldNameChar(c);
+            value[c] = allowedFieldValueChar(c);
+            hex[c] = -1;
+        }
+        for (int c = 0; c < 10; c++)
+            hex['0' + c] = c;
+        for (int c = 0; c < 6; c++)
+        {
+            hex['a' + c] = 10 + c;
+            hex['A' + c] = 10 + c;
+        }
     }
-    return false;
+};
+
+static const ScanTables scan_tables;
+
+/*
+scalar fallback: returns the length of the run of table characters at the start of data
+*/
+static size_t  scanTable(const uint8_t *data, size_t len, const bool *table)
+{
+    size_t i = 0;
+
+    while (i < len && table[data[i]])
+        i++;
+    return i;
 }
 
+#if defined(__x86_64__) || defined(__i386__)
 /*
-does percent decoding on the URI
+SSE4.2 scan over 16 bytes at a time (as in picohttpparser):
+    - ranges holds up to 8 pairs of allowed character ranges, PCMPESTRI with negative polarity
+      returns the index of the first byte outside of all of them, or 16
+    - the tail shorter than 16 bytes is left to the scalar scan
 */
-static void percent_decoding(std::string &path)
+__attribute__((target("sse4.2")))
+static size_t  scanRangesSse42(const uint8_t *data, size_t len, const char *ranges, int ranges_len)
 {
-    std::string decoded_path;
+    const __m128i   r = _mm_loadu_si128((const __m128i *)ranges);
+    size_t          i = 0;
+    int             idx;
 
-    for (size_t i = 0; i < path.length(); ++i)
+    while (len - i >= 16)
     {
-        if (path[i] == '%') 
-        {
-            if (i + 2 < path.length())
-            {
-                std::string hex = path.substr(i + 1, 2);
-                char decoded_char = static_cast<char>(strtol(hex.c_str(), NULL, 16));
-                decoded_path.push_back(decoded_char);
-                i += 2;
-            }
-            else 
-                decoded_path.push_back(path[i]);
-        } 
-        else 
-            decoded_path.push_back(path[i]);
+        idx = _mm_cmpestri(r, ranges_len, _mm_loadu_si128((const __m128i *)(data + i)), 16,
+                _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx != 16)
+            return i + idx;
+        i += 16;
     }
-    path = decoded_path;
+    return i;
 }
 
 /*
-Checks for consecutive slashes in the path string and deletes them
+AVX2 scan of field value characters over 32 bytes at a time:
+    - as signed bytes everything above 0x1f except DEL is VCHAR or SP (bytes >= 0x80 are negative), plus HTAB
+    - the tail shorter than 32 bytes is left to the scalar scan
 */
-static void    checkPathConsecutiveSlashes(std::string &path)
+__attribute__((target("avx2")))
+static size_t  scanFieldValueAvx2(const uint8_t *data, size_t len)
 {
-    bool    slash_flag = false;
+    const __m256i   space = _mm256_set1_epi8(0x1f);
+    const __m256i   del = _mm256_set1_epi8(0x7f);
+    const __m256i   tab = _mm256_set1_epi8('\t');
+    size_t          i = 0;
 
-    for (size_t i = 0; i < path.size(); i++)
+    while (len - i >= 32)
     {
-        if (slash_flag && path[i] == '/')
+        __m256i     b = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i     ok = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(b, del), _mm256_cmpgt_epi8(b, space)), _mm256_cmpeq_epi8(b, tab));
+        unsigned    mask = ~(unsigned)_mm256_movemask_epi8(ok);
+
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+        i += 32;
+    }
+    return i;
+}
+#endif
+
+enum ScanLevel
+{
+    SCAN_SCALAR,
+    SCAN_SSE42,
+    SCAN_AVX2,
+};
+
+/*
+picks the widest scanner the cpu supports, once at startup
+*/
+static ScanLevel    detectScanLevel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SCAN_AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return SCAN_SSE42;
+#endif
+    return SCAN_SCALAR;
+}
+
+static const ScanLevel  scan_level = detectScanLevel();
+
+/*
+returns the length of the run of URI characters (without '?' and '#') at the start of data
+*/
+static size_t  scanURIChars(const uint8_t *data, size_t len)
+{
+    size_t  i = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+    static const char   ranges[16] = {'!', '!', '$', ';', '=', '=', '@', '[', ']', ']', '_', '_', 'a', 'z', '~', '~'};
+
+    if (scan_level != SCAN_SCALAR)
+        i = scanRangesSse42(data, len, ranges, 16);
+#endif
+    return i + scanTable(data + i, len - i, scan_tables.uri);
+}
+
+/*
+returns the length of the run of token characters at the start of data,
+field names are short, so the scalar scan is used
+*/
+static size_t  scanFieldNameChars(const uint8_t *data, size_t len)
+{
+    return scanTable(data, len, scan_tables.name);
+}
+
+/*
+returns the length of the run of field value characters at the start of data
+*/
+static size_t  scanFieldValueChars(const uint8_t *data, size_t len)
+{
+    size_t  i = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+    static const char   ranges[16] = {'\t', '\t', ' ', '~'};
+
+    if (scan_level == SCAN_AVX2)
+        i = scanFieldValueAvx2(data, len);
+    else if (scan_level == SCAN_SSE42)
+        i = scanRangesSse42(data, len, ranges, 4);
+#endif
+    return i + scanTable(data + i, len - i, scan_tables.value);
+}
+
+/*
+removes the segment which just ended at the end of buf, if it is "." or "..":
+    - "." is dropped, ".." is dropped together with the segment before it
+    - returns false if ".." would go above the root
+*/
+static bool    removeDotSegment(char *buf, size_t &len)
+{
+    if (len >= 2 && buf[len - 1] == '.' && buf[len - 2] == '/')
+        len -= 1;
+    else if (len >= 3 && buf[len - 1] == '.' && buf[len - 2] == '.' && buf[len - 3] == '/')
+    {
+        len -= 2;
+        if (len == 1)
+            return false;
+        len--;
+        while (buf[len - 1] != '/')
+            len--;
+    }
+    return true;
+}
+
+/*
+normalizes the path of the URI in one pass into a buffer on the stack:
+    - percent decoding through the hex table, invalid escapes and NUL are a bad request
+    - consecutive slashes are collapsed, "." and ".." segments are resolved
+    - a path going above the root is forbidden
+    - returns the error or OK
+*/
+static int normalizePath(const char *src, size_t len, std::string &path)
+{
+    char    buf[MAX_URI_LENGTH + 2];
+    size_t  out = 0;
+    size_t  i = 0;
+    char    c;
+
+    while (i < len)
+    {
+        c = src[i++];
+        if (c == '%')
         {
-            path.erase(i, 1);
-            i--;
+            if (i + 1 >= len || scan_tables.hex[(uint8_t)src[i]] < 0 || scan_tables.hex[(uint8_t)src[i + 1]] < 0)
+                return BAD_REQUEST;
+            c = scan_tables.hex[(uint8_t)src[i]] * 16 + scan_tables.hex[(uint8_t)src[i + 1]];
+            i += 2;
+            if (c == '\0')
+                return BAD_REQUEST;
         }
-        if (path[i] == '/')
-            slash_flag = true;
+        if (c != '/')
+            buf[out++] = c;
+        else if (!removeDotSegment(buf, out))
+            return FORBIDDEN;
+        else if (out == 0 || buf[out - 1] != '/')
+            buf[out++] = '/';
+    }
+    if (!removeDotSegment(buf, out))
+        return FORBIDDEN;
+    path.assign(buf, out);
+    return OK;
+}
+
+/*
+perfect hash of the known header names (generated like gperf does it):
+    - the slot is (length + value of the first letter + value of the last letter) & 15,
+      with the letters lowercased, the nine names all land in different slots
+    - a name is known if it matches the one in its slot, case-insensitive
+*/
+struct HeaderName
+{
+    const char  *name;
+    size_t      len;
+    KnownHeader id;
+};
+
+static const unsigned char  header_asso[26] = {
+    0, 0, 5, 0, 1, 0, 11, 14, 0, 0, 0, 0, 0,     // a - m
+    12, 0, 0, 0, 1, 0, 13, 0, 0, 0, 0, 0, 0,    // n - z
+};
+
+static const HeaderName     header_table[16] = {
+    {"content-encoding", 16, HEADER_CONTENT_ENCODING},
+    {"content-length", 14, HEADER_CONTENT_LENGTH},
+    {"content-type", 12, HEADER_CONTENT_TYPE},
+    {"content-range", 13, HEADER_CONTENT_RANGE},
+    {"expect", 6, HEADER_EXPECT},
+    {NULL, 0, HEADER_OTHER},
+    {NULL, 0, HEADER_OTHER},
+    {"range", 5, HEADER_RANGE},
+    {NULL, 0, HEADER_OTHER},
+    {"transfer-encoding", 17, HEADER_TRANSFER_ENCODING},
+    {NULL, 0, HEADER_OTHER},
+    {"connection", 10, HEADER_CONNECTION},
+    {NULL, 0, HEADER_OTHER},
+    {NULL, 0, HEADER_OTHER},
+    {NULL, 0, HEADER_OTHER},
+    {"host", 4, HEADER_HOST},
+};
+
+/*
+parses the value of Content-Length, only digits are valid (a huge value stays huge)
+*/
+static bool parseContentLength(const char *value, size_t len, size_t &length)
+{
+    length = 0;
+    if (len == 0)
+        return false;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!isdigit(value[i]))
+            return false;
+        if (length > (SIZE_MAX - 9) / 10)
+            length = SIZE_MAX;
         else
-            slash_flag = false; 
+            length = length * 10 + (value[i] - '0');
+    }
+    return true;
+}
+
+/*
+checks if the comma separated list of a Connection value holds the option (case-insensitive)
+*/
+static bool hasConnectionOption(const char *value, size_t len, const char *option)
+{
+    size_t  option_len = strlen(option);
+    size_t  start = 0;
+    size_t  end;
+
+    while (start < len)
+    {
+        end = start;
+        while (end < len && value[end] != ',')
+            end++;
+        while (start < end && (value[start] == ' ' || value[start] == '\t'))
+            start++;
+        while (end > start && (value[end - 1] == ' ' || value[end - 1] == '\t'))
+            end--;
+        if (end - start == option_len && strncasecmp(value + start, option, option_len) == 0)
+            return true;
+        while (end < len && value[end] != ',')
+            end++;
+        start = end + 1;
     }
+    return false;
 }
 
 /*
 Deletes optional leading whitespace and optional trailing whitespace of the field line value
 */
-static void    trimFieldValueStr(std::string &string)
+static void    trimFieldValue(const char *raw, HeaderField &field)
 {
-    while (iswspace(string[0]))
-        string.erase(0, 1);
-    while (iswspace(string[string.size() - 1]))
-        string.erase(string.size() - 1);
-    return;
+    while (field._value_len > 0 && iswspace(raw[field._value]))
+    {
+        field._value++;
+        field._value_len--;
+    }
+    while (field._value_len > 0 && iswspace(raw[field._value + field._value_len - 1]))
+        field._value_len--;
 }
 
 // ======   Private Member functions   ======= //
+/*
+lends _raw out of the buffer pool, or a large buffer once the head outgrows the one it has
+    - a head which would not fit into a large buffer keeps the large buffer, parse() cuts it off
+    - returns false (500) if the pool has no memory
+*/
+bool    Request::_lendRaw(size_t size)
+{
+    char    *raw;
+
+    if (size <= _raw_size || _raw_size == IO_LARGE_BUFFER_SIZE)
+        return true;
+    size = std::min(size, (size_t)IO_LARGE_BUFFER_SIZE);
+    if ((raw = BufferPool::acquire(size)) == NULL)
+    {
+        _error = INTERNAL_SERVER_ERROR;
+        return false;
+    }
+    if (_raw_len > 0)
+        std::memcpy(raw, _raw, _raw_len);
+    BufferPool::release(_raw, _raw_size);
+    _raw = raw;
+    _raw_size = size;
+    return true;
+}
+
+/*
+prepares the decompression of a body with Content-Encoding gzip or deflate (identity needs none):
+    - the header gets removed, the body is passed on decoded
+    - Content-Length counts the decoded bytes from now on
+    - returns false for an unknown coding (415) or if zlib fails
+*/
+bool    Request::_setupDecoding()
+{
+    std::string coding = getHeader(HEADER_CONTENT_ENCODING);
+
+    for (size_t i = 0; i < coding.size(); i++)
+        coding[i] = std::tolower(coding[i]);
+    if (coding == "identity")
+        return true;
+    if (coding != "gzip" && coding != "x-gzip" && coding != "deflate")
+    {
+        _error = UNSUPPORTED_MEDIA_TYPE;
+        return false;
+    }
+    _inflate = new z_stream;
+    std::memset(_inflate, 0, sizeof(z_stream));
+    // 32: the gzip or zlib header is detected by zlib
+    if (inflateInit2(_inflate, 32 + MAX_WBITS) != Z_OK)
+    {
+        Logger::log(RED, ERROR, "Initializing the decompression of the request body failed");
+        delete _inflate;
+        _inflate = NULL;
+        _error = INTERNAL_SERVER_ERROR;
+        return false;
+    }
+    _removeHeader(HEADER_CONTENT_ENCODING);
+    _body_encoded = true;
+    _content_length = 0;
+    return true;
+}
+
+/*
+decompresses the body bytes from start on, which arrived in this call of parse(), in place:
+    - the output is produced in pieces of REQUEST_INFLATE_SIZE, client_max_body_size limits
+      the decoded size (a zip bomb stops there)
+    - data after the end of the compressed stream and a stream ending before the body are invalid
+*/
+void    Request::_decodeBody(size_t start)
+{
+    std::string encoded = _body.substr(start);
+    char        buffer[REQUEST_INFLATE_SIZE];
+    int         ret = Z_OK;
+
+    _body.erase(start);
+    if (_inflate == NULL && !encoded.empty())
+        _error = BAD_REQUEST;
+    if (_inflate == NULL || _error != OK)
+        return ;
+    _inflate->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(encoded.data()));
+    _inflate->avail_in = encoded.size();
+    do
+    {
+        _inflate->next_out = reinterpret_cast<Bytef *>(buffer);
+        _inflate->avail_out = sizeof(buffer);
+        ret = inflate(_inflate, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+        {
+            _error = BAD_REQUEST;
+            return ;
+        }
+        _body.append(buffer, sizeof(buffer) - _inflate->avail_out);
+        if (_inflate->total_out > _client_max_body_size)
+        {
+            _error = PAYLOAD_TOO_LARGE;
+            return ;
+        }
+    } while (ret == Z_OK && (_inflate->avail_in > 0 || _inflate->avail_out == 0));
+    _content_length = _inflate->total_out;
+    if (ret == Z_STREAM_END)
+    {
+        if (_inflate->avail_in > 0)
+            _error = BAD_REQUEST;
+        _endDecoding();
+    }
+    else if (_state == Parsing_Finished)
+        _error = BAD_REQUEST;
+}
+
+/*
+frees the state of the decompression
+*/
+void    Request::_endDecoding()
+{
+    if (_inflate == NULL)
+        return ;
+    inflateEnd(_inflate);
+    delete _inflate;
+    _inflate = NULL;
+}
+
 /*
 finding the correct server block for the request
 */
-void    Request::_findServerBlock(std::string host)
+void    Request::_findServerBlock(const HeaderField *host)
 {
-    bool found_default = false;
+    const std::vector<ServerBlock>  &server_blocks = _config->getServerBlocks();
+    bool                            found_default = false;
 
-    for (size_t i = 0; i < _server_blocks.size(); i++)
+    for (size_t i = 0; i < server_blocks.size(); i++)
     {
         // search for default server block
-        if (found_default == false && _server_blocks[i]._host == _socket->getHost() && _server_blocks[i]._port == _socket->getPort())
+        if (found_default == false && server_blocks[i]._host == _socket->getHost() && server_blocks[i]._port == _socket->getPort())
         {
-            _server = &_server_blocks[i];
-            _client_max_body_size = _server_blocks[i]._client_max_body_size;
+            _server = &server_blocks[i];
+            _client_max_body_size = server_blocks[i]._client_max_body_size;
             found_default = true;
         }
         // search for server_block with the host header
-        const std::vector<std::string> &server_names = _server_blocks[i]._server_names;
+        const std::vector<std::string> &server_names = server_blocks[i]._server_names;
         for (size_t j = 0; j < server_names.size(); j++)
         {
-            if (server_names[j] == host && _server_blocks[i]._host == _socket->getHost() && _server_blocks[i]._port == _socket->getPort())
+            if (server_names[j].size() == host->_value_len && std::memcmp(_raw + host->_value, server_names[j].data(), host->_value_len) == 0 && server_blocks[i]._host == _socket->getHost() && server_blocks[i]._port == _socket->getPort())
             {
-                _server = &_server_blocks[i];
-                _client_max_body_size = _server_blocks[i]._client_max_body_size;
+                _server = &server_blocks[i];
+                _client_max_body_size = server_blocks[i]._client_max_body_size;
                 return;
             }
         }
@@ -280,47 +811,163 @@ void    Request::_findServerBlock(std::string host)
         _error = BAD_REQUEST;
 }
 
+/*
+stores the field which just ended:
+    - a known field goes into its slot, a repetition of it into the list as well (as other fields)
+    - more than one Host or different Content-Length values are invalid (400)
+    - Content-Length is kept as a number, the options of Connection as flags
+    - returns false on error
+*/
+bool    Request::_addHeader()
+{
+    const char  *value = _raw + _field._value;
+    size_t      length;
+
+    _field._id = lookupHeader(_raw + _field._name, _field._name_len);
+    if (_field._id == HEADER_CONTENT_LENGTH)
+    {
+        if (!parseContentLength(value, _field._value_len, length) || (hasHeader(HEADER_CONTENT_LENGTH) && length != _content_length))
+        {
+            _error = BAD_REQUEST;
+            return false;
+        }
+        _content_length = length;
+    }
+    else if (_field._id == HEADER_HOST && hasHeader(HEADER_HOST))
+    {
+        _error = BAD_REQUEST;
+        return false;
+    }
+    else if (_field._id == HEADER_CONNECTION)
+    {
+        _keep_alive = _keep_alive || hasConnectionOption(value, _field._value_len, "keep-alive");
+        _close = _close || hasConnectionOption(value, _field._value_len, "close");
+    }
+    if (_field._id != HEADER_OTHER && !hasHeader(_field._id))
+        _known[_field._id] = _field;
+    else
+    {
+        if (_field._id != HEADER_OTHER)
+            _repeated |= 1u << _field._id;
+        _fields.push_back(_field);
+    }
+    return true;
+}
+
+/*
+removes a known field and its repetitions
+*/
+void    Request::_removeHeader(KnownHeader id)
+{
+    size_t  i = 0;
+
+    std::memset(&_known[id], 0, sizeof(HeaderField));
+    while (i < _fields.size())
+    {
+        if (_fields[i]._id == id)
+            _fields.erase(_fields.begin() + i);
+        else
+            i++;
+    }
+    _repeated &= ~(1u << id);
+}
+
 // ==========   Member functions   =========== //
 /*
 clears and resets all variables (except _client_max_body_size) in the object
+    - the buffer of the head goes back to the pool, the reference to the configuration is dropped
+    - the other buffers keep their memory for the next request, a body keeps up to IO_BUFFER_SIZE of it
 */
 void    Request::clear()
 {
     _state = Empty_Line;
     _error = OK;
     _method = NONE;
-    _path = "";
-    _query = "";
-    _fragment = "";
+    BufferPool::release(_raw, _raw_size);
+    _raw = NULL;
+    _raw_len = 0;
+    _raw_size = 0;
+    _path.clear();
+    _path_start = 0;
+    _query_start = 0;
+    _query_len = 0;
+    _fragment_start = 0;
+    _fragment_len = 0;
     _version_major = 0;
     _version_minor = 0;
-    _body = "";
-    _method_str = "";
-    _header_field_name = "";
-    _header_field_value = "";
-    _chunk_length_str = "";
+    _body.clear();
+    if (_body.capacity() > IO_BUFFER_SIZE)
+        std::string().swap(_body);
+    _method_str.clear();
+    std::memset(_known, 0, sizeof(_known));
+    _repeated = 0;
+    std::memset(&_field, 0, sizeof(_field));
+    _keep_alive = false;
+    _close = false;
+    _chunk_digits = 0;
     _uri_len = 0;
     _header_len = 0;
     _body_len = 0;
     _chunk_len = 0;
+    _content_length = 0;
+    if (_body_fd >= 0)
+        close(_body_fd);
+    _body_fd = -1;
     _body_flag = false;
     _chunked_transfer_flag = false;
+    _expect_continue = false;
+    _body_encoded = false;
+    _endDecoding();
     _client_max_body_size = 0;
     _server = NULL;
-    _ss.str("");
-    _ss.clear();
-    _headers.clear();
+    if (_config != NULL)
+        _config->release();
+    _config = NULL;
+    _fields.clear();
 }
 
 /*
 partial parses the http Request octet by octet
+    - the bytes of the request line and the header section are kept in _raw, the parts of the URI
+      and the header fields are offsets into it (offset of data[i]: base + i), strings are
+      only made when they are asked for
+    - _raw is lent from the buffer pool with the first byte of the request, a head which
+      does not fit into a large buffer is answered with 431
+    - inside the URI, a field name or a field value the rest of an ordinary run is scanned
+      (SSE4.2/AVX2 if available) and skipped at once, the byte which ends the run
+      goes through the state machine again, so runs split between reads work the same
 */
 void    Request::parse(uint8_t *data, size_t size)
 {
     uint8_t ch;
+    size_t  body_start = _body.size();
+    size_t  run;
+    size_t  base;
 
     if (_error != OK)
         return;
+    // nothing before the request line is kept, a body does not go into _raw
+    if (_state == Empty_Line)
+        _raw_len = 0;
+    base = _raw_len;
+    if (_state <= Header_Field_Blank_Line)
+    {
+        if (!_lendRaw(base + size))
+            return;
+        // the bytes up to the end of a full large buffer are parsed first, the head has to end in them
+        if (base + size > _raw_size)
+        {
+            size_t  kept = _raw_size - base;
+
+            parse(data, kept);
+            if (_error == OK && _state <= Header_Field_Blank_Line)
+                _error = REQUEST_HEADER_FIELDS_TOO_LARGE;
+            parse(data + kept, size - kept);
+            return;
+        }
+        std::memcpy(_raw + base, data, size);
+        _raw_len = base + size;
+    }
     for (size_t i = 0; i < size; i++) 
     {
         ch = data[i];
@@ -342,6 +989,10 @@ void    Request::parse(uint8_t *data, size_t size)
                     _method = POST;
                 else if (_method_str.compare("DELETE") == 0)
                     _method = DELETE;
+                else if (_method_str.compare("PUT") == 0)
+                    _method = PUT;
+                else if (_method_str.compare("HEAD") == 0)
+                    _method = HEAD;
                 else
                     _method = NONE;
                 _state = Request_Line_URI_Slash;
@@ -360,18 +1011,26 @@ void    Request::parse(uint8_t *data, size_t size)
                 _error = BAD_REQUEST;
                 return;
             }
-            _path.push_back(ch);
+            _path_start = base + i;
             _uri_len++;
             _state = Request_Line_URI_Path;
             break;
         case Request_Line_URI_Path:
+            if (ch == '?' || ch == '#' || ch == ' ')
+            {
+                _error = normalizePath(_raw + _path_start, base + i - _path_start, _path);
+                if (_error != OK)
+                    return;
+            }
             if (ch == '?')
             {
+                _query_start = base + i + 1;
                 _state = Request_Line_URI_Query;
                 break;
             } 
             else if (ch == '#')
             {
+                _fragment_start = base + i + 1;
                 _state = Request_Line_URI_Fragment;
                 break;
             }
@@ -392,13 +1051,18 @@ void    Request::parse(uint8_t *data, size_t size)
                     _error = URI_TOO_LONG;
                     return;
                 }
-                _path.push_back(ch);
                 _uri_len++;
+                run = std::min(scanURIChars(data + i + 1, size - i - 1), (size_t)MAX_URI_LENGTH + 1 - _uri_len);
+                _uri_len += run;
+                i += run;
             }
             break;
         case Request_Line_URI_Query:
+            if (ch == '#' || ch == ' ')
+                _query_len = base + i - _query_start;
             if (ch == '#')
             {
+                _fragment_start = base + i + 1;
                 _state = Request_Line_URI_Fragment;
                 break;
             }    
@@ -419,14 +1083,17 @@ void    Request::parse(uint8_t *data, size_t size)
                     _error = URI_TOO_LONG;
                     return;
                 }
-                _query.push_back(ch);
                 _uri_len++;
+                run = std::min(scanURIChars(data + i + 1, size - i - 1), (size_t)MAX_URI_LENGTH + 1 - _uri_len);
+                _uri_len += run;
+                i += run;
             }
             break;
         case Request_Line_URI_Fragment:
             if (ch == ' ')
             {
-               _state = Request_Line_H;
+                _fragment_len = base + i - _fragment_start;
+                _state = Request_Line_H;
                 break;
             }
             else
@@ -441,18 +1108,13 @@ void    Request::parse(uint8_t *data, size_t size)
                     _error = URI_TOO_LONG;
                     return;
                 }
-                _fragment.push_back(ch);
                 _uri_len++;
+                run = std::min(scanURIChars(data + i + 1, size - i - 1), (size_t)MAX_URI_LENGTH + 1 - _uri_len);
+                _uri_len += run;
+                i += run;
             }
             break;
         case Request_Line_H:
-            checkPathConsecutiveSlashes(_path);
-            percent_decoding(_path);
-            if (checkPathUnderRoot(_path))
-            {
-                _error = FORBIDDEN;
-                return;
-            }
             if (ch != 'H')
             {
                 _error = BAD_REQUEST;
@@ -545,7 +1207,7 @@ void    Request::parse(uint8_t *data, size_t size)
                 _error = BAD_REQUEST;
                 return;
             }
-            _header_field_name.push_back(ch);
+            _field._name = base + i;
             _header_len++;
             if (_header_len > MAX_HEADER_LENGTH)
             {
@@ -557,6 +1219,8 @@ void    Request::parse(uint8_t *data, size_t size)
         case Header_Field_Name:
             if (ch == ':')
             {
+                _field._name_len = base + i - _field._name;
+                _field._value = base + i + 1;
                 _state = Header_Field_Value;
                 break;
             }
@@ -565,18 +1229,21 @@ void    Request::parse(uint8_t *data, size_t size)
                 _error = BAD_REQUEST;
                 return;
             }
-            _header_field_name.push_back(ch);
             _header_len++;
             if (_header_len > MAX_HEADER_LENGTH)
             {
                 _error = REQUEST_HEADER_FIELDS_TOO_LARGE;
                 return;
             }
+            run = std::min(scanFieldNameChars(data + i + 1, size - i - 1), (size_t)MAX_HEADER_LENGTH - _header_len);
+            _header_len += run;
+            i += run;
             break;
         case Header_Field_Value:
             if (ch == CR)
             {
-                if (_header_field_value.size() < 1)
+                _field._value_len = base + i - _field._value;
+                if (_field._value_len < 1)
                 {
                     _error = BAD_REQUEST;
                     return;
@@ -589,13 +1256,15 @@ void    Request::parse(uint8_t *data, size_t size)
                 _error = BAD_REQUEST;
                 return;
             }
-            _header_field_value.push_back(ch);
             _header_len++;
             if (_header_len > MAX_HEADER_LENGTH)
             {
                 _error = REQUEST_HEADER_FIELDS_TOO_LARGE;
                 return;
             }
+            run = std::min(scanFieldValueChars(data + i + 1, size - i - 1), (size_t)MAX_HEADER_LENGTH - _header_len);
+            _header_len += run;
+            i += run;
             break;
         case Header_Field_End:
             if (ch != LF)
@@ -603,16 +1272,9 @@ void    Request::parse(uint8_t *data, size_t size)
                 _error = BAD_REQUEST;
                 return;
             }
-            trimFieldValueStr(_header_field_value);
-            if (_headers.count(_header_field_name))
-            {
-                _headers[_header_field_name] += ", ";
-                _headers[_header_field_name] += _header_field_value;
-            }
-            else
-                _headers.insert(std::pair<std::string, std::string>(_header_field_name, _header_field_value));
-            _header_field_name.clear();
-            _header_field_value.clear();
+            trimFieldValue(_raw, _field);
+            if (!_addHeader())
+                return;
             _state = Header_Field_Start;
             break;
         case Header_Field_Blank_Line:
@@ -622,25 +1284,36 @@ void    Request::parse(uint8_t *data, size_t size)
                 return;
             }
             _state = Parsing_Finished;
-            if (!_headers.count("Host"))
+            _raw_len = base + i + 1;
+            if (!hasHeader(HEADER_HOST))
 	        {
 		        _error = BAD_REQUEST;
                 return;
 	        }
             else
             {
-                _findServerBlock(_headers.find("Host")->second);
+                _findServerBlock(&_known[HEADER_HOST]);
                 if (_error != OK)
                 return ;
             }
-            if (_headers.count("Transfer-Encoding"))
+            // only 100-continue is known, a HTTP/1.0 client gets no 100 (Continue)
+            if (hasHeader(HEADER_EXPECT))
+            {
+                if (strcasecmp(getHeader(HEADER_EXPECT).c_str(), "100-continue") != 0)
+                {
+                    _error = EXPECTATION_FAILED;
+                    return;
+                }
+                _expect_continue = _version_major > 1 || (_version_major == 1 && _version_minor >= 1);
+            }
+            if (hasHeader(HEADER_TRANSFER_ENCODING))
             {
                 if((_version_major == 1 && _version_minor == 0) || _version_major == 0)
                 {
                     _error = BAD_REQUEST;
                     return;
                 }
-                if (_headers["Transfer-Encoding"] == "chunked")
+                if (strcasecmp(getHeader(HEADER_TRANSFER_ENCODING).c_str(), "chunked") == 0)
                 {
                     _body_flag = true;
                     _chunked_transfer_flag = true;
@@ -652,14 +1325,14 @@ void    Request::parse(uint8_t *data, size_t size)
                     return;
                 }
             }
-            if (_headers.count("Content-Length"))
+            if (hasHeader(HEADER_CONTENT_LENGTH))
             {
                 if (_chunked_transfer_flag == true)
                 {
                     _error = BAD_REQUEST;
                     return;
                 }
-                _body_len = atoi(_headers["Content-Length"].c_str());
+                _body_len = _content_length;
                 if (_body_len <= 0)
                 {
                     _error = BAD_REQUEST;
@@ -676,42 +1349,68 @@ void    Request::parse(uint8_t *data, size_t size)
                     _state = Message_Body;
                 }   
             }
-            else if (_method == POST)
+            else if ((_method == POST || _method == PUT) && !_chunked_transfer_flag)
             {
                 _error = LENGTH_REQUIRED;
                 return ;
             }
+            if (_body_flag && hasHeader(HEADER_CONTENT_ENCODING) && !_setupDecoding())
+                return ;
+            // a body longer than client_body_buffer_size gets spilled, it never needs more memory
+            if (_state == Message_Body && !_body_encoded)
+                _body.reserve(std::min(_content_length, _server->_client_body_buffer_size));
             break;
         case Chunk_Length:
+            // the size is summed up digit by digit, a chunk larger than the body may be is refused right away
             _body_len++;
+            if ((ch == CR || ch == ';') && _chunk_digits == 0)
+            {
+                _error = BAD_REQUEST;
+                return;
+            }
             if (ch == CR)
                 _state = Chunk_Length_End;
             else if (ch == ';')
                 _state = Chunk_Extensions;
-            else if (isxdigit(ch))
-                _chunk_length_str.push_back(ch);
+            else if (scan_tables.hex[ch] >= 0)
+            {
+                // a size which does not fit into size_t would wrap around, it is refused before
+                if (_chunk_len > (SIZE_MAX >> 4))
+                {
+                    _error = BAD_REQUEST;
+                    return;
+                }
+                _chunk_len = _chunk_len * 16 + scan_tables.hex[ch];
+                _chunk_digits++;
+            }
             else
             {
                 _error = BAD_REQUEST;
                 return;
             }
-            if (_body_len > _client_max_body_size)
+            if (_body_len > _client_max_body_size || _chunk_len > _client_max_body_size)
             {
                 _error = PAYLOAD_TOO_LARGE;
                 return;
             }
             break;
         case Chunk_Extensions:
-            // ignores the chunk extensions
-            _body_len++;
-            if (ch == CR)
-                _state = Chunk_Length_End;
+        {
+            // ignores the chunk extensions, up to the CR in one step
+            const uint8_t   *cr = static_cast<const uint8_t *>(memchr(data + i, CR, size - i));
+            size_t          len = (cr != NULL) ? cr - (data + i) + 1 : size - i;
+
+            _body_len += len;
             if (_body_len > _client_max_body_size)
             {
                 _error = PAYLOAD_TOO_LARGE;
                 return;
             }
+            if (cr != NULL)
+                _state = Chunk_Length_End;
+            i += len - 1;
             break;
+        }
         case Chunk_Length_End:
             _body_len++;
             if (ch != '\n')
@@ -725,28 +1424,29 @@ void    Request::parse(uint8_t *data, size_t size)
                 return;
             }
             _state = Chunk_Data;
-            _ss.str("");
-            _ss.clear();
-            _ss << _chunk_length_str;
-            _ss >> std::hex >> _chunk_len;
+            _chunk_digits = 0;
             if (_chunk_len == 0)
                 _state = Chunk_Last_CR;
             break;
         case Chunk_Data:
-            if (_chunk_len > 0)
-            {
-                _body.push_back(ch);
-                _body_len++;
-                _chunk_len--;
-            }
-            if (_body_len > _client_max_body_size)
+        {
+            // the chunk is taken over in one piece, as far as it is in the buffer
+            size_t len = std::min(_chunk_len, size - i);
+
+            if (_body_len + len > _client_max_body_size)
             {
                 _error = PAYLOAD_TOO_LARGE;
                 return;
             }
+            _body.append(reinterpret_cast<char *>(data + i), len);
+            _body_len += len;
+            _chunk_len -= len;
+            _content_length += len;
+            i += len - 1;
             if (_chunk_len == 0)
                 _state = Chunk_Data_CR;
             break;
+        }
         case Chunk_Data_CR:
             if (ch != CR)
             {
@@ -800,7 +1500,8 @@ void    Request::parse(uint8_t *data, size_t size)
                 _error = PAYLOAD_TOO_LARGE;
                 return;
             }
-            _state = Chunk_Trailer_Section;
+            // trailer fields are rejected by Chunk_Last_CR, the request ends with this LF
+            _state = Parsing_Finished;
             _body_len++;
             break;
         case Chunk_Trailer_Section:
@@ -808,16 +1509,140 @@ void    Request::parse(uint8_t *data, size_t size)
             _state = Parsing_Finished;
             break;
         case Message_Body:
-            if (_body_len)
-            {
-                _body.push_back(ch);
-                _body_len--;
-            }
+        {
+            // the body is taken over in one piece, as far as it is in the buffer
+            size_t len = std::min(_body_len, size - i);
+
+            _body.append(reinterpret_cast<char *>(data + i), len);
+            _body_len -= len;
+            i += len - 1;
             if (_body_len == 0)
                 _state = Parsing_Finished;
             break;
+        }
         case Parsing_Finished:
-            return;
+            i = size;
+            break;
+        }
+    }
+    if (_body_encoded)
+        _decodeBody(body_start);
+    // a spilled body only stays in memory until the end of the buffer
+    if (_body_fd >= 0 && !_body.empty())
+    {
+        if (write(_body_fd, _body.c_str(), _body.size()) != (ssize_t)_body.size())
+        {
+            Logger::log(RED, ERROR, "Spilling the request body into a file failed: %s", strerror(errno));
+            _error = INTERNAL_SERVER_ERROR;
         }
+        _body.clear();
     }
 }
+
+/*
+the client waits for 100 (Continue) before it sends the body
+*/
+bool    Request::expectsContinue() const
+{
+    return _expect_continue;
+}
+
+/*
+the client asked to keep the connection open (Connection: keep-alive without close)
+*/
+bool    Request::isKeepAlive() const
+{
+    return _keep_alive && !_close;
+}
+
+/*
+the body arrives compressed (Content-Encoding gzip or deflate), its length is known only at its end
+*/
+bool    Request::isBodyEncoded() const
+{
+    return _body_encoded;
+}
+
+/*
+the headers are parsed and the body is still arriving
+*/
+bool    Request::isReadingBody() const
+{
+    return _state >= Chunk_Length && _state < Parsing_Finished;
+}
+
+/*
+moves the body into a file from now on, instead of keeping it in memory
+    - for a chunked body to a cgi: the cgi gets it as its stdin, once its length is known
+    - for a body beyond client_body_buffer_size: the rest is not buffered in memory anymore
+    - the file is an unnamed O_TMPFILE in client_body_temp_path (or the root), an upload can
+      get linked from there into the upload directory without copying it
+    - a memfd is used if the file system has no O_TMPFILE support
+    - returns false if no file could be created, the body stays in memory then
+*/
+bool    Request::spillBody()
+{
+    std::string temp_dir;
+
+    if (_server != NULL)
+        temp_dir = _server->_client_body_temp_path.empty() ? _server->_root : _server->_client_body_temp_path;
+    _body_fd = -1;
+    if (!temp_dir.empty() && (_body_fd = open(temp_dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0666)) < 0)
+        Logger::log(YELLOW, INFO, "Creating a temporary file in %s failed: %s, using a memfd", temp_dir.c_str(), strerror(errno));
+    if (_body_fd < 0 && (_body_fd = memfd_create("request_body", MFD_CLOEXEC)) < 0)
+    {
+        Logger::log(RED, ERROR, "Creating a memfd for the request body failed: %s", strerror(errno));
+        return false;
+    }
+    if (!_body.empty() && write(_body_fd, _body.c_str(), _body.size()) != (ssize_t)_body.size())
+    {
+        Logger::log(RED, ERROR, "Spilling the request body into a file failed: %s", strerror(errno));
+        close(_body_fd);
+        _body_fd = -1;
+        return false;
+    }
+    _body.clear();
+    return true;
+}
+
+/*
+removes the first n bytes of the body, once they are passed on to the cgi or written to an upload
+*/
+void    Request::trimBody(size_t n)
+{
+    _body.erase(0, n);
+}
+
+/*
+counts n bytes of a body with Content-Length as read, which went around the parser
+(spliced straight into the file of an upload)
+*/
+void    Request::skipBody(size_t n)
+{
+    _body_len -= std::min(n, _body_len);
+    if (_body_len == 0)
+        _state = Parsing_Finished;
+}
+
+// =======   Static member functions   ======= //
+/*
+returns the known header with the name (case-insensitive), or HEADER_OTHER
+*/
+KnownHeader Request::lookupHeader(const char *name, size_t len)
+{
+    unsigned char   first;
+    unsigned char   last;
+
+    if (len == 0)
+        return HEADER_OTHER;
+    first = std::tolower(name[0]);
+    last = std::tolower(name[len - 1]);
+    if (first < 'a' || first > 'z' || last < 'a' || last > 'z')
+        return HEADER_OTHER;
+
+    const HeaderName    &entry = header_table[(len + header_asso[first - 'a'] + header_asso[last - 'a']) & 15];
+
+    if (entry.len != len || strncasecmp(entry.name, name, len) != 0)
+        return HEADER_OTHER;
+    return entry.id;
+}
@@ -1,16 +1,93 @@
 #include "../inc/Response.hpp"
 
 // =============   Constructor   ============= //
-Response::Response()
+/*
+the headers are allocated in the arena of the response, it is rewound by clear() after each request
+*/
+Response::Response() : _headers(std::less<std::string>(), HeaderMap::allocator_type(&_arena))
 {
     _response = "";
     _error = OK;
     _body = "";
+    _cgi = NULL;
+    _multipart = NULL;
+    _cache_bypass = false;
+    _revalidate = false;
+    _file_fd = -1;
+    _file_offset = 0;
+    _file_remaining = 0;
+    _stream_pipe[0] = -1;
+    _stream_pipe[1] = -1;
+    _stream_pending = 0;
+    _stream_remaining = -1;
+    _stream_chunked = false;
+    _stream_eof = false;
+    _upload_fd = -1;
+    _upload_pipe[0] = -1;
+    _upload_pipe[1] = -1;
+    _upload_status = OK;
+    _upload_offset = 0;
+    _upload_size = -1;
+    _upload_created = false;
+}
+
+// ===========   Copy Constructor   ========== //
+/*
+a running cgi, an upload, an open file and a stream are owned by exactly one response and are not copied
+*/
+Response::Response(const Response &rhs) : _headers(std::less<std::string>(), HeaderMap::allocator_type(&_arena))
+{
+    _cgi = NULL;
+    _multipart = NULL;
+    _file_fd = -1;
+    _file_offset = 0;
+    _file_remaining = 0;
+    _stream_pipe[0] = -1;
+    _stream_pipe[1] = -1;
+    _stream_pending = 0;
+    _stream_remaining = -1;
+    _stream_chunked = false;
+    _stream_eof = false;
+    _upload_fd = -1;
+    _upload_pipe[0] = -1;
+    _upload_pipe[1] = -1;
+    _upload_status = OK;
+    _upload_offset = 0;
+    _upload_size = -1;
+    _upload_created = false;
+    *this = rhs;
+}
+
+// ==========   Assignment Operator   ======== //
+Response &Response::operator=(const Response &rhs)
+{
+    if (this != &rhs)
+    {
+        _error = rhs._error;
+        _response = rhs._response;
+        _body = rhs._body;
+        _client_addr = rhs._client_addr;
+        _headers = rhs._headers;
+        _cache_key = rhs._cache_key;
+        _cache_bypass = rhs._cache_bypass;
+        _revalidate = rhs._revalidate;
+    }
+    return *this;
 }
 
 // ============   Deconstructor   ============ //
 Response::~Response()
 {
+    delete _cgi;
+    delete _multipart;
+    if (_file_fd >= 0)
+        close(_file_fd);
+    if (_stream_pipe[0] >= 0)
+    {
+        close(_stream_pipe[0]);
+        close(_stream_pipe[1]);
+    }
+    _closeUpload();
 }
 
 // ==============   Getters   ================ //
@@ -24,6 +101,28 @@ int Response::getError() const
     return _error;
 }
 
+CgiHandler *Response::getCgi() const
+{
+    return _cgi;
+}
+
+/*
+true if the response got served from a stale cache entry, which should be refreshed in the background
+*/
+bool Response::needsRevalidation() const
+{
+    return _revalidate;
+}
+
+// ==============   Setters   ================ //
+/*
+the next response skips the cache lookup (for the background refresh of a stale entry)
+*/
+void Response::bypassCache()
+{
+    _cache_bypass = true;
+}
+
 // ================   Utils   ================ //
 /*
 returns an string accordingly to the error_code
@@ -34,6 +133,8 @@ static  std::string lookupErrorMessage(int error_code)
     case  200: return "OK";
     case  201: return "Created";
     case  202: return "Accepted";
+    case  204: return "No Content";
+    case  206: return "Partial Content";
     case  301: return "Moved Permanently";
     case  302: return "Found";
     case  303: return "See Other";
@@ -98,32 +199,32 @@ return an string for the content-type header corresponding to the requested file
 */
 static std::string getMimeType(const std::string& filename)
 {
+    static const char   *mime_types[][2] = {
+        {".html", "text/html"},
+        {".htm", "text/html"},
+        {".css", "text/css"},
+        {".js", "application/javascript"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".pdf", "application/pdf"},
+        {".txt", "text/plain"},
+        {".ico", "image/x-icon"},
+        {".mp3", "audio/mpeg"},
+        {".mp4", "video/mp4"},
+        {".sh", "application/x-sh"},
+        {".json", "application/json"},
+    };
     size_t dotPos = filename.find_last_of(".");
     
     if (dotPos != std::string::npos)
     {
-        std::map<std::string, std::string> mimeTypes;
-
-        mimeTypes[".html"] = "text/html";
-        mimeTypes[".htm"] = "text/html";
-        mimeTypes[".css"] = "text/css";
-        mimeTypes[".js"] = "application/javascript";
-        mimeTypes[".png"] = "image/png";
-        mimeTypes[".jpg"] = "image/jpeg";
-        mimeTypes[".jpeg"] = "image/jpeg";
-        mimeTypes[".gif"] = "image/gif";
-        mimeTypes[".pdf"] = "application/pdf";
-        mimeTypes[".txt"] = "text/plain";
-        mimeTypes[".gif"] = "image/gif";
-        mimeTypes[".ico"] = "image/x-icon";
-        mimeTypes[".mp3"] = "audio/mpeg";
-        mimeTypes[".mp4"] = "video/mp4";
-        mimeTypes[".sh"] = "application/x-sh";
-        mimeTypes[".json"] = "application/json";
-        std::string extension = filename.substr(dotPos);
-        std::map<std::string, std::string>::iterator it = mimeTypes.find(extension);
-        if (it != mimeTypes.end())
-            return it->second;
+        for (size_t i = 0; i < sizeof(mime_types) / sizeof(mime_types[0]); i++)
+        {
+            if (filename.compare(dotPos, std::string::npos, mime_types[i][0]) == 0)
+                return mime_types[i][1];
+        }
     }
     return "application/octet-stream";
 }
@@ -164,30 +265,31 @@ static std::string _buildDefaultErrorPage(int error_code)
 }
 
 /*
-builds an html autoindex and returns it as a string
+builds an html autoindex of the opened directory fd (which it closes) and returns it as a string
 */
-static std::string buildAutoindex(std::string path_with_root, std::string root)
+static std::string buildAutoindex(int fd, std::string path_with_root, std::string root)
 {
     std::ostringstream  oss;
     std::string path_without_root = path_with_root;
     path_without_root = "/" + path_without_root.erase(0, root.size());
     std::vector<std::string> files;
-    DIR* dir = opendir(path_with_root.c_str());
+    DIR* dir = fdopendir(fd);
     if (dir) 
     {
         struct dirent* entry;
         while ((entry = readdir(dir)) != NULL)
             files.push_back(entry->d_name);
-        closedir(dir);
     }
     else
-        Logger::log(RED, ERROR, "Could not open directory: %s", path_with_root);
+    {
+        Logger::log(RED, ERROR, "Could not open directory: %s", path_with_root.c_str());
+        close(fd);
+    }
     oss << "<!DOCTYPE html><html><head><title>Index of " << path_without_root << "</title></head><body><h1>Index of " << path_without_root << "</h1><hr><pre>";
-    for (size_t i = 0; i < files.size(); ++i)
+    for (size_t i = 0; dir && i < files.size(); ++i)
     {
         struct stat file_info;
-        std::string full_path = path_with_root + "/" + files[i];
-        if (stat(full_path.c_str(), &file_info) == 0)
+        if (fstatat(dirfd(dir), files[i].c_str(), &file_info, 0) == 0)
         {
             oss << "<a href=\"";
             if (S_ISDIR(file_info.st_mode))
@@ -198,18 +300,20 @@ static std::string buildAutoindex(std::string path_with_root, std::string root)
         }
     }
     oss << "</pre><hr></body></html>";
+    if (dir)
+        closedir(dir);
     return oss.str();
 }
 
 /*
 searches the right location for the request
 */
-static std::map<std::string, Location>::iterator   findLocation(std::string path, std::map<std::string, Location> &locations)
+static std::map<std::string, Location>::const_iterator   findLocation(std::string path, const std::map<std::string, Location> &locations)
 {
-    std::map<std::string, Location>::iterator location = locations.end();
+    std::map<std::string, Location>::const_iterator location = locations.end();
     size_t size = 0;
 
-    for (std::map<std::string, Location>::iterator it = locations.begin(); it != locations.end(); it++)
+    for (std::map<std::string, Location>::const_iterator it = locations.begin(); it != locations.end(); it++)
     {
         if (path == it->first)
         {
@@ -228,16 +332,225 @@ static std::map<std::string, Location>::iterator   findLocation(std::string path
     return location;
 }
 
+/*
+maps the (normalized) path of an uri to the file system: the root of the server, or the alias
+of the location in place of the location prefix
+*/
+static std::string  resolvePath(const std::string &path, const ServerBlock &server, std::map<std::string, Location>::const_iterator location)
+{
+    if (location->second._alias != "")
+        return location->second._alias + path.substr(location->first.size());
+    return server._root + path.substr(1);
+}
+
+/*
+checks if the path (after resolving symlinks and "..") lies inside the root directory
+*/
+static bool isBelowRoot(const std::string &path, const std::string &root)
+{
+    char    real_path[PATH_MAX];
+    char    real_root[PATH_MAX];
+
+    if (realpath(path.c_str(), real_path) == NULL || realpath(root.c_str(), real_root) == NULL)
+        return false;
+
+    size_t  len = std::strlen(real_root);
+
+    return std::strncmp(real_path, real_root, len) == 0 && (real_path[len] == '/' || real_root[len - 1] == '/');
+}
+
+/*
+opens a path starting with the root of the server relative to the directory fd of the root,
+with openat2(RESOLVE_BENEATH): neither ".." nor a symlink can lead out of it
+    - without openat2 (kernel before 5.6) the path is opened and checked with isBelowRoot()
+    - returns the fd or -1, errno is EXDEV for a path leading out of the root
+*/
+static int  openBelowRoot(const ServerBlock &server, const std::string &path, int flags)
+{
+    const char      *relative = path.c_str();
+    int             fd;
+
+    if (path.compare(0, server._root.size(), server._root) == 0)
+        relative += server._root.size();
+    if (*relative == '\0')
+        relative = ".";
+#ifdef SYS_openat2
+    struct open_how how;
+
+    std::memset(&how, 0, sizeof(how));
+    how.flags = flags | O_CLOEXEC;
+    how.resolve = RESOLVE_BENEATH;
+    if ((fd = syscall(SYS_openat2, server._root_fd, relative, &how, sizeof(how))) >= 0 || errno != ENOSYS)
+        return fd;
+#endif
+    if ((fd = open(path.c_str(), flags | O_CLOEXEC)) >= 0 && !isBelowRoot(path, server._root))
+    {
+        close(fd);
+        errno = EXDEV;
+        return -1;
+    }
+    return fd;
+}
+
+/*
+parses a "Range: bytes=..." header for a file of the given size ("bytes=0-99", "bytes=100-", "bytes=-100"):
+    - returns 1 and sets first and last (inclusive) for a satisfiable range
+    - returns 0 if the header should be ignored (other unit, several ranges or invalid syntax)
+    - returns -1 if the range can not be satisfied
+*/
+static int  parseRange(const std::string &value, off_t size, off_t &first, off_t &last)
+{
+    if (value.compare(0, 6, "bytes=") != 0 || value.find(',') != std::string::npos)
+        return 0;
+
+    std::string spec = value.substr(6);
+    size_t      dash = spec.find('-');
+
+    if (dash == std::string::npos || spec.find_first_not_of("0123456789-") != std::string::npos || spec.find('-', dash + 1) != std::string::npos)
+        return 0;
+    std::string first_str = spec.substr(0, dash);
+    std::string last_str = spec.substr(dash + 1);
+    if (first_str.empty() && last_str.empty())
+        return 0;
+    if (first_str.empty())
+    {
+        // suffix range: the last bytes of the file
+        off_t suffix = strtoll(last_str.c_str(), NULL, 10);
+        if (suffix == 0 || size == 0)
+            return -1;
+        first = suffix < size ? size - suffix : 0;
+        last = size - 1;
+        return 1;
+    }
+    first = strtoll(first_str.c_str(), NULL, 10);
+    last = last_str.empty() ? size - 1 : strtoll(last_str.c_str(), NULL, 10);
+    if (first >= size)
+        return -1;
+    if (last < first)
+        return 0;
+    if (last >= size)
+        last = size - 1;
+    return 1;
+}
+
+/*
+transforms a chunk size into the hex string of the chunked transfer coding
+*/
+static std::string  sizeToHex(size_t n)
+{
+    std::ostringstream oss;
+
+    oss << std::hex << n;
+    return oss.str();
+}
+
+/*
+transforms an offset into a string (file sizes do not fit into an int)
+*/
+static std::string  offToStr(off_t n)
+{
+    std::ostringstream oss;
+
+    oss << n;
+    return oss.str();
+}
+
+/*
+checks if the method is allowed at the location:
+    - HEAD is allowed with GET, and with PUT to find out how much of an upload arrived
+*/
+static bool isMethodAllowed(HttpMethod method, const Location &location)
+{
+    switch (method) {
+    case GET:
+        return location._allowed_methods._allow_get;
+    case POST:
+        return location._allowed_methods._allow_post;
+    case DELETE:
+        return location._allowed_methods._allow_delete;
+    case PUT:
+        return location._allowed_methods._allow_put;
+    case HEAD:
+        return location._allowed_methods._allow_get || location._allowed_methods._allow_put;
+    default:
+        return false;
+    }
+}
+
+/*
+reads the Content-Range of a PUT ("bytes first-last/total", total can be '*'), returns false if it is invalid
+*/
+static bool parseContentRange(const std::string &value, off_t &first, off_t &last)
+{
+    const char  *str = value.c_str() + 6;
+    char        *end;
+    off_t       total;
+
+    if (value.compare(0, 6, "bytes ") != 0 || !isdigit(*str))
+        return false;
+    first = strtoll(str, &end, 10);
+    if (*end != '-' || !isdigit(end[1]))
+        return false;
+    last = strtoll(end + 1, &end, 10);
+    if (*end != '/' || last < first)
+        return false;
+    if (std::strcmp(end + 1, "*") == 0)
+        return true;
+    str = end + 1;
+    total = strtoll(str, &end, 10);
+    return isdigit(*str) && *end == '\0' && total > last;
+}
+
+/*
+flushes the directory holding path to the disk, so a new directory entry survives a crash
+*/
+bool syncDirectory(const std::string &path)
+{
+    size_t      slash = path.rfind('/');
+    std::string dir = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+    int         fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    bool        synced;
+
+    if (fd < 0)
+        return false;
+    synced = (fsync(fd) == 0);
+    close(fd);
+    return synced;
+}
+
+/*
+gives the unnamed temporary file of a spooled body (see Request::spillBody()) the name path:
+    - it gets linked under a temporary name next to path and renamed over it,
+      so an existing file is replaced atomically
+    - fails for a memfd or a temp path on another file system, the body has to be copied then
+*/
+static bool linkBody(int body_fd, const std::string &path, UploadFsync sync)
+{
+    std::string proc_path = "/proc/self/fd/" + intToStr(body_fd);
+    std::string tmp_path = path + ".tmp" + intToStr(getpid());
+
+    if (sync != FSYNC_OFF && fsync(body_fd) != 0)
+        return false;
+    if (linkat(AT_FDCWD, proc_path.c_str(), AT_FDCWD, tmp_path.c_str(), AT_SYMLINK_FOLLOW) != 0)
+        return false;
+    if (rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
 // ======   Private member functions   ======= //
 /*
 sets _connection either to 'close' or 'keep-alive' depending on _error and client request
+    - a request whose body did not arrive completely (a cgi answered early) closes the connection
 */
 void Response::_setConnection(Request& request)
 {
-    if (_error < 400)
+    if (_error < 400 && request.getParsingState() == Parsing_Finished)
     {
-        std::map<std::string, std::string>::const_iterator it = request.getHeaders().find("Connection");
-        if(it != request.getHeaders().end() && it->second == "keep-alive")
+        if (request.isKeepAlive())
         {
             _headers.insert(std::make_pair("Connection", "keep-alive"));
             return;
@@ -250,15 +563,15 @@ void Response::_setConnection(Request& request)
 /*
 searches for custom error page or uses default error page to setup the _body string
 */
-void Response::_buildErrorPage(ServerBlock &server)
+void Response::_buildErrorPage(const ServerBlock &server)
 {
-    std::map<int, std::string> error_pages = server._error_pages;
+    std::map<int, std::string>::const_iterator error_page = server._error_pages.find(_error);
 
     _body.clear();
-    if (error_pages.count(_error))
+    if (error_page != server._error_pages.end())
     {
-        _body = readFile(error_pages[_error]);
-        _headers.insert(std::make_pair("Content-Type", getMimeType(error_pages[_error])));
+        _body = readFile(error_page->second);
+        _headers.insert(std::make_pair("Content-Type", getMimeType(error_page->second)));
     }
     else
     {
@@ -270,14 +583,17 @@ void Response::_buildErrorPage(ServerBlock &server)
 /*
 handles an GET request
 */
-void Response::_handleGet(ServerBlock &server, std::string path, Location &location)
+void Response::_handleGet(Request &request, const ServerBlock &server, std::string path, const Location &location)
 {
     struct stat file_info;
+    int         fd = openBelowRoot(server, path, O_RDONLY);
     
-    // file does not exist
-    if (stat(path.c_str(), &file_info) != 0)
+    // file does not exist (or is outside of the root)
+    if (fd < 0 || fstat(fd, &file_info) != 0)
     {
-        _error = NOT_FOUND;
+        _error = (errno == EACCES || errno == EXDEV) ? FORBIDDEN : NOT_FOUND;
+        if (fd >= 0)
+            close(fd);
         return ;
     }
     // checks if targt is directory
@@ -286,6 +602,7 @@ void Response::_handleGet(ServerBlock &server, std::string path, Location &locat
         // Path does not ends with "/" or "/$"
         if (path[path.size() - 1] != '/' && path.compare(path.size() - 2, 2, "/$") != 0)
         {
+            close(fd);
             _error = MOVED_PERMANENTLY;
             _headers.insert(std::make_pair("Location", path + "/"));
             return;
@@ -293,19 +610,27 @@ void Response::_handleGet(ServerBlock &server, std::string path, Location &locat
         // check for index
         if (location._index != "")
         {
-            _body = readFile(location._index);
-            _headers.insert(std::make_pair("Content-Type", getMimeType(location._index)));
+            close(fd);
+            if ((fd = openBelowRoot(server, location._index, O_RDONLY)) < 0 || fstat(fd, &file_info) != 0)
+            {
+                _error = (errno == EACCES || errno == EXDEV) ? FORBIDDEN : NOT_FOUND;
+                if (fd >= 0)
+                    close(fd);
+            }
+            else
+                _serveFile(request, location._index, fd, file_info);
             return ;
         }
         // check for autoindex
         if (location._autoindex == false)
         {
+            close(fd);
             _error = FORBIDDEN;
             return ;
         }
         else
         {
-            _body = buildAutoindex(path, server._root);
+            _body = buildAutoindex(fd, path, server._root);
             _headers.insert(std::make_pair("Content-Type", "text/html"));
             return ;
         }
@@ -313,122 +638,390 @@ void Response::_handleGet(ServerBlock &server, std::string path, Location &locat
     // checks if target is regular file
     else if (S_ISREG(file_info.st_mode))
     {
-        _body = readFile(path);
-        _headers.insert(std::make_pair("Content-Type", getMimeType(path)));
+        _serveFile(request, path, fd, file_info);
         return ;
     }
     else
     {
+        close(fd);
         _error = NOT_FOUND;
         return ;
     }
 }
 
 /*
-handles an POST request
+serves the opened regular file fd without reading it into the body: it gets sent with sendFile() after the headers
+    - a single range of the Range header is served as 206 (416 if it can not be satisfied)
+    - the Content-Type is taken from the extension of path, unless it is set already (by a cgi)
 */
-void Response::_handlePost(Request &request, std::string path, Location &location)
+void Response::_serveFile(Request &request, const std::string &path, int fd, const struct stat &file_info)
 {
-    if (location._upload.empty())
+    off_t   first = 0;
+    off_t   last = file_info.st_size - 1;
+    int     satisfiable = 0;
+
+    if (request.hasHeader(HEADER_RANGE))
+        satisfiable = parseRange(request.getHeader(HEADER_RANGE), file_info.st_size, first, last);
+    if (satisfiable < 0)
     {
-        _error = FORBIDDEN;
-        return;
+        _error = RANGE_NOT_SATISFIABLE;
+        _headers["Content-Range"] = "bytes */" + offToStr(file_info.st_size);
+        close(fd);
+        return ;
+    }
+    _file_fd = fd;
+    if (satisfiable > 0)
+    {
+        _error = PARTIAL_CONTENT;
+        _headers["Content-Range"] = "bytes " + offToStr(first) + "-" + offToStr(last) + "/" + offToStr(file_info.st_size);
     }
+    _file_offset = first;
+    _file_remaining = file_info.st_size ? last - first + 1 : 0;
+    _headers["Content-Length"] = offToStr(_file_remaining);
+    _headers["Accept-Ranges"] = "bytes";
+    _headers.insert(std::make_pair("Content-Type", getMimeType(path)));
+}
+
+/*
+serves the file a cgi names instead of its body:
+    - X-Accel-Redirect: an uri, mapped to the file system like a request
+    - X-Sendfile: a path, which has to be inside the root of the server
+    - both are opened with openBelowRoot(), neither '..' nor a symlink leads out of the root
+    - both headers are internal and get removed from the response
+*/
+void Response::_checkSendfile(Request &request)
+{
+    const ServerBlock &server = *request.getServerBlock();
+    std::string path;
     struct stat file_info;
+    int         fd = -1;
 
-    // std::cout << request.getHeaders().at("Content-Type") << std::endl;
-    // std::cout << request.getBody() << std::endl;
-    if (stat(path.c_str(), &file_info) == 0 && S_ISDIR(file_info.st_mode)) // upload a file
+    if (_headers.count("X-Accel-Redirect"))
     {
-        size_t content_start;
-        size_t content_end;
-        std::string filename;
-        std::string filepath;
-        filepath = location._upload;
-    
-        std::cout << request.getBody() << std::endl;
-        if(request.getHeaders().at("Content-Type").find("multipart/form-data") != std::string::npos)
+        std::string                                 uri = _headers["X-Accel-Redirect"];
+        std::map<std::string, Location>::const_iterator   location = findLocation(uri, server._locations);
+
+        if (location != server._locations.end() && uri[0] == '/')
         {
-            std::istringstream file_content(request.getBody());
-            std::string boundary;
-            std::getline(file_content, boundary);
-            boundary.erase(boundary.find_last_not_of("\r\n") + 1);
-            std::string boundary_end = boundary;
-            boundary_end.append("--");
-            size_t pos = request.getBody().find("filename") + 10;
-            if (pos != std::string::npos)
-            {
-                size_t filename_end = request.getBody().find('\"', pos);
-                if (filename_end != std::string::npos){
-                    filename = request.getBody().substr(pos, filename_end - pos);
-                }
-                else{
-                    _error = BAD_REQUEST;
-                    return ;}
-            }
-            else{
-                _error = BAD_REQUEST;
-                return ;}
-            
-            filepath = filepath + "/" + filename;
-            content_end = request.getBody().find(boundary_end) - 2;
-            content_start = request.getBody().find("\r\n\r\n") + 4;
+            path = resolvePath(uri, server, location);
+            fd = openBelowRoot(server, path, O_RDONLY);
         }
-        else
+    }
+    else if (_headers.count("X-Sendfile"))
+    {
+        char    real_root[PATH_MAX];
+        size_t  len = 0;
+
+        path = _headers["X-Sendfile"];
+        // an absolute path inside the root is made relative to it, it gets opened beneath the root fd
+        if (realpath(server._root.c_str(), real_root) != NULL && (len = std::strlen(real_root)) < path.size()
+            && path.compare(0, len, real_root) == 0 && path[len] == '/')
+            path = server._root + path.substr(len + 1);
+        fd = openBelowRoot(server, path, O_RDONLY);
+    }
+    else
+        return ;
+    _headers.erase("X-Accel-Redirect");
+    _headers.erase("X-Sendfile");
+    _headers.erase("Content-Length");
+    _body.clear();
+    if (_error == OK && (fd < 0 || fstat(fd, &file_info) != 0 || !S_ISREG(file_info.st_mode)))
+    {
+        Logger::log(RED, ERROR, "CGI named an invalid file to send: %s", path.c_str());
+        _error = NOT_FOUND;
+    }
+    if (_error != OK)
+    {
+        if (fd >= 0)
+            close(fd);
+        return ;
+    }
+    _serveFile(request, path, fd, file_info);
+}
+
+/*
+handles an HEAD request like a GET request, _assembleResponse() drops the body
+    - for a file in an upload location Upload-Offset tells a client where to resume an interrupted PUT
+*/
+void Response::_handleHead(Request &request, const ServerBlock &server, std::string path, const Location &location)
+{
+    struct stat file_info;
+    int         fd;
+
+    _handleGet(request, server, path, location);
+    if (location._upload.empty() || (fd = openBelowRoot(server, path, O_RDONLY)) < 0)
+        return ;
+    if (fstat(fd, &file_info) == 0 && S_ISREG(file_info.st_mode))
+        _headers["Upload-Offset"] = offToStr(file_info.st_size);
+    close(fd);
+}
+
+/*
+decides where the body of an upload is stored, returns the status of the response (or an error):
+    - POST to a directory: as a new file named after the current date in the upload directory
+    - POST to an existing file: appended to it, to a missing file: as that file
+    - PUT: as the target file, with Content-Range at its offset in the file, which may not be
+      beyond the current end (Upload-Offset tells the client where it is)
+*/
+int Response::_uploadTarget(Request &request, const std::string &path, const Location &location, std::string &target, int &flags, off_t &offset)
+{
+    struct stat file_info;
+    bool        exists = (stat(path.c_str(), &file_info) == 0);
+    off_t       last;
+
+    target = path;
+    flags = O_TRUNC;
+    offset = 0;
+    if (request.getMethod() == PUT)
+    {
+        if (exists && !S_ISREG(file_info.st_mode))
+            return CONFLICT;
+        if (!request.hasHeader(HEADER_CONTENT_RANGE))
+            return exists ? NO_CONTENT : CREATED;
+        if (!parseContentRange(request.getHeader(HEADER_CONTENT_RANGE), offset, last) || (size_t)(last - offset + 1) != request.getContentLength())
+            return BAD_REQUEST;
+        if (offset > (exists ? file_info.st_size : 0))
         {
-            filename = getCurrentDateTime();
-            path = location._alias;
-            filepath = filepath + filename;
-            content_start = 0;
-            content_end = request.getBody().length();
-        }
-        std::ifstream file(filepath.c_str());
-        if (file.good())
-            _error = NO_CONTENT;
-        std::ofstream outFile(filepath.c_str(), std::ios::binary);
-        if(outFile.is_open()){
-            outFile << request.getBody().substr(content_start, content_end - content_start);
-            outFile.close();
-            if(_error != NO_CONTENT)
-                _error = CREATED;
-            return;
+            _headers["Upload-Offset"] = offToStr(exists ? file_info.st_size : 0);
+            return RANGE_NOT_SATISFIABLE;
         }
-        else
+        flags = 0;
+        return exists ? NO_CONTENT : CREATED;
+    }
+    if (exists && S_ISDIR(file_info.st_mode))
+    {
+        target = location._upload + getCurrentDateTime();
+        return (access(target.c_str(), F_OK) == 0) ? NO_CONTENT : CREATED;
+    }
+    if (exists && S_ISREG(file_info.st_mode))
+        flags = O_APPEND;
+    return flags == O_APPEND ? OK : CREATED;
+}
+
+/*
+writes len bytes of the body from start on into the file at path at offset (truncated first or appended to
+with the flags), offset is moved to the end of the written bytes:
+    - a whole spooled body stored into a new file gets linked into place instead of being copied
+    - otherwise a spooled body is copied inside the kernel, a body in memory gets written with pwrite()
+    - upload_fsync decides if the file (file) and its directory entry (full) get synced before answering
+    - returns false on error
+*/
+bool Response::_storeBody(Request &request, const std::string &path, int flags, off_t &offset, const char *data, size_t start, size_t len, const Location &location)
+{
+    int     body_fd = request.getBodyFd();
+    int     fd;
+    ssize_t bytes;
+
+    if (body_fd >= 0 && flags == O_TRUNC && start == 0 && linkBody(body_fd, path, location._upload_fsync))
+    {
+        offset = len;
+        return location._upload_fsync != FSYNC_FULL || syncDirectory(path);
+    }
+    // no O_APPEND, pwrite() and copy_file_range() would ignore the offset
+    if ((fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (flags & O_TRUNC), 0666)) < 0
+        || ((flags & O_APPEND) && (offset = lseek(fd, 0, SEEK_END)) < 0))
+    {
+        Logger::log(RED, ERROR, "Opening %s for the upload failed: %s", path.c_str(), strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    if (body_fd >= 0)
+    {
+        loff_t  in_offset = start;
+        loff_t  out_offset = offset;
+
+        while (len > 0 && (bytes = copy_file_range(body_fd, &in_offset, fd, &out_offset, len, 0)) > 0)
         {
-            _error = INTERNAL_SERVER_ERROR;
-            return;
+            start += bytes;
+            offset += bytes;
+            len -= bytes;
         }
     }
-    else // checks if target is regular file
+    // the rest (all of it, if copy_file_range() is not supported for the files)
+    while (len > 0 && (bytes = pwrite(fd, data + start, len, offset)) > 0)
+    {
+        start += bytes;
+        offset += bytes;
+        len -= bytes;
+    }
+    if (len > 0 || (location._upload_fsync != FSYNC_OFF && fsync(fd) != 0))
     {
-        // write to existing file
-        if (stat(path.c_str(), &file_info) == 0 && S_ISREG(file_info.st_mode))
+        Logger::log(RED, ERROR, "Writing the upload to %s failed: %s", path.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+    close(fd);
+    return location._upload_fsync != FSYNC_FULL || syncDirectory(path);
+}
+
+/*
+handles an POST or PUT request
+    - a multipart body to the upload directory gets split into its files, see _uploadTarget()
+      for any other body
+    - the response to PUT tells the offset behind the stored bytes in Upload-Offset
+    - a raw upload which got spliced into its file already (see buildUpload()) only gets finished
+    - a body spooled to a file is mapped into memory, if it has to be parsed or copied from there
+*/
+void Response::_handlePost(Request &request, std::string path, const Location &location)
+{
+    if (location._upload.empty())
+    {
+        _error = FORBIDDEN;
+        return;
+    }
+    if (_upload_fd >= 0)
+    {
+        if (request.getMethod() == PUT)
+            _headers["Upload-Offset"] = offToStr(_upload_offset);
+        _error = _finishUpload(location);
+        return ;
+    }
+    std::string content_type = request.getHeader(HEADER_CONTENT_TYPE);
+    struct stat file_info;
+    const char  *body = request.getBody().data();
+    size_t      body_len = request.getBody().size();
+    void        *map = NULL;
+    std::string target;
+    int         flags;
+    off_t       offset;
+
+    if (request.getBodyFd() >= 0)
+    {
+        if (fstat(request.getBodyFd(), &file_info) != 0)
         {
-            std::fstream outFile(path.c_str(), std::ios::binary | std::ios::in | std::ios::out | std::ios::app);
-            if(outFile.is_open()){
-                outFile << request.getBody();
-                outFile.close();
-            }
-            else{
-                _error = INTERNAL_SERVER_ERROR;
-                return ;}
+            _error = INTERNAL_SERVER_ERROR;
+            return ;
         }
-        // create new file
-        else{
-            std::ofstream outFile(path.c_str(), std::ios::binary);
-            if(outFile.is_open()){
-                outFile << request.getBody();
-                outFile.close();
-                _error = CREATED;
-            }
-            else
-            {
-                _error = INTERNAL_SERVER_ERROR;
-                return ;
-            }
+        body_len = file_info.st_size;
+        if (body_len > 0 && (map = mmap(NULL, body_len, PROT_READ, MAP_PRIVATE, request.getBodyFd(), 0)) == MAP_FAILED)
+        {
+            Logger::log(RED, ERROR, "Mapping the spooled request body failed: %s", strerror(errno));
+            _error = INTERNAL_SERVER_ERROR;
+            return ;
         }
+        body = (map != NULL) ? static_cast<const char *>(map) : "";
+    }
+    // the parts of a multipart body are written by the parser of buildUpload(), or from here
+    if (_multipart == NULL && request.getMethod() == POST && stat(path.c_str(), &file_info) == 0 && S_ISDIR(file_info.st_mode)
+        && content_type.find("multipart/form-data") != std::string::npos)
+    {
+        std::string boundary = Multipart::getBoundary(content_type);
+
+        if (!boundary.empty())
+            _multipart = new Multipart(boundary, location._upload, location._upload_fsync);
+        else
+            _error = BAD_REQUEST;
+    }
+    if (_multipart != NULL)
+    {
+        _multipart->feed(body, body_len);
+        _error = _multipart->finish();
+    }
+    else if (_error == OK)
+    {
+        int status = _uploadTarget(request, path, location, target, flags, offset);
+
+        if (status < 400 && !_storeBody(request, target, flags, offset, body, 0, body_len, location))
+            status = INTERNAL_SERVER_ERROR;
+        if (status < 400 && request.getMethod() == PUT)
+            _headers["Upload-Offset"] = offToStr(offset);
+        _error = status;
+    }
+    if (map != NULL)
+        munmap(map, body_len);
+}
+
+/*
+opens the file of a raw upload and a pipe, spliceUpload() moves the rest of the body from the socket
+into the file from now on, the part which arrived with the headers is written here
+    - the file is opened without O_APPEND (splice() refuses it), the body is written at _upload_offset
+    - until the upload is finished, a file it created gets removed again and a file it appends to gets
+      cut back to its size before (_closeUpload()), a ranged PUT keeps its part so it can be resumed
+    - returns false if that fails (or the upload is invalid), the body gets buffered by the request then
+*/
+bool Response::_openUpload(Request &request, const std::string &path, const Location &location)
+{
+    const std::string   &body = request.getBody();
+    size_t              written = 0;
+    ssize_t             bytes = 0;
+    int                 flags;
+    struct stat         file_info;
+
+    if ((_upload_status = _uploadTarget(request, path, location, _upload_path, flags, _upload_offset)) >= 400)
+        return false;
+    if (stat(_upload_path.c_str(), &file_info) != 0)
+        _upload_created = (flags != 0);
+    else if (flags & O_APPEND)
+        _upload_size = file_info.st_size;
+    if ((_upload_fd = open(_upload_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (flags & O_TRUNC), 0666)) < 0
+        || ((flags & O_APPEND) && (_upload_offset = lseek(_upload_fd, 0, SEEK_END)) < 0) || pipe2(_upload_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        Logger::log(RED, ERROR, "Opening %s for the upload failed: %s", _upload_path.c_str(), strerror(errno));
+        _closeUpload();
+        return false;
+    }
+    // a larger pipe moves more of the body per splice(), the default size works as well
+    fcntl(_upload_pipe[1], F_SETPIPE_SZ, UPLOAD_SPLICE_SIZE);
+    while (written < body.size() && (bytes = pwrite(_upload_fd, body.data() + written, body.size() - written, _upload_offset)) > 0)
+    {
+        written += bytes;
+        _upload_offset += bytes;
+    }
+    if (written < body.size())
+    {
+        Logger::log(RED, ERROR, "Writing the upload to %s failed: %s", _upload_path.c_str(), strerror(errno));
+        _closeUpload();
+        return false;
+    }
+    request.trimBody(body.size());
+    Logger::log(GREY, DEBUG, "Splicing the upload into %s", _upload_path.c_str());
+    return true;
+}
+
+/*
+syncs the file of a finished raw upload as upload_fsync says and closes it, returns the status of the response
+*/
+int Response::_finishUpload(const Location &location)
+{
+    int status = _upload_status;
+
+    _upload_created = false;
+    _upload_size = -1;
+    if ((location._upload_fsync != FSYNC_OFF && fsync(_upload_fd) != 0)
+        || (location._upload_fsync == FSYNC_FULL && !syncDirectory(_upload_path)))
+    {
+        Logger::log(RED, ERROR, "Syncing the upload %s failed: %s", _upload_path.c_str(), strerror(errno));
+        status = INTERNAL_SERVER_ERROR;
     }
-    return ;
+    _closeUpload();
+    return status;
+}
+
+/*
+closes the file and the pipe of a raw upload, an upload which did not get finished is undone:
+    - a file it created is removed, a file it appended to is cut back to its size before
+*/
+void Response::_closeUpload()
+{
+    if (_upload_fd >= 0)
+    {
+        if (_upload_created && unlink(_upload_path.c_str()) == 0)
+            Logger::log(YELLOW, INFO, "Removed the incomplete upload %s", _upload_path.c_str());
+        else if (_upload_size >= 0 && ftruncate(_upload_fd, _upload_size) == 0)
+            Logger::log(YELLOW, INFO, "Cut the incomplete upload to %s back to its size before", _upload_path.c_str());
+        close(_upload_fd);
+    }
+    if (_upload_pipe[0] >= 0)
+    {
+        close(_upload_pipe[0]);
+        close(_upload_pipe[1]);
+    }
+    _upload_fd = -1;
+    _upload_pipe[0] = -1;
+    _upload_pipe[1] = -1;
+    _upload_created = false;
+    _upload_size = -1;
 }
 
 /*
@@ -470,18 +1063,25 @@ void Response::_handleDelete(std::string path)
 
 /*
 checks if the request needs cgi:
-    - returns true and executes cgi if cgi is necessary
+    - returns true and starts cgi if cgi is necessary (or the location has fastcgi_pass)
     - returns false if no cgi is needed
 */
-bool Response::_checkCgi(Request &request, ServerBlock &server, std::string path, Location &location)
+bool Response::_checkCgi(Request &request, const ServerBlock &server, std::string path, const Location &location)
 {
     if (_error != OK)
         return false;
 
     // checks if method is working with cgi
-    if (request.getMethod() != GET && request.getMethod() != POST)
+    if (request.getMethod() != GET && request.getMethod() != POST && request.getMethod() != HEAD)
         return false;
 
+    // checks if the location passes all requests to a FastCGI server
+    if (!location._fastcgi_pass.empty())
+    {
+        _createCgi(request, server, location, path, "");
+        return true;
+    }
+
     // checks if cgi is allowed
     if (location._cgi.size() == 0)
         return false;
@@ -513,28 +1113,75 @@ bool Response::_checkCgi(Request &request, ServerBlock &server, std::string path
         return false;
     
     std::string extension = path.substr(pos, path.size() - pos);
-    if (location._cgi.count(extension))
-    {
-        // handle cgi
-        CgiHandler cgi(request, server, path, location._cgi[extension], _client_addr);
+    std::map<std::string, std::string>::const_iterator cgi = location._cgi.find(extension);
 
-        cgi.execCgi();
-        _body = cgi.getBody();
-        _headers.insert(cgi.getHeaders().begin(), cgi.getHeaders().end());
-        if (cgi.getError() != OK)
-            _error = cgi.getError();
+    if (cgi != location._cgi.end())
+    {
+        _createCgi(request, server, location, path, cgi->second);
         return true;
     }
     return false;
 }
 
+/*
+creates the cgi (or the FastCGI request if binary_path is empty)
+    - if the response is in the cgi cache of the location, no cgi is needed
+    - it gets started by startCgi(), once the location has a free slot for it
+*/
+void Response::_createCgi(Request &request, const ServerBlock &server, const Location &location, std::string path, std::string binary_path)
+{
+    if (_serveFromCache(request, location))
+        return ;
+    _cgi = new CgiHandler(request, server, location, path, binary_path, _client_addr);
+}
+
+/*
+answers GET requests to a location with cgi_cache from the cache:
+    - a fresh entry is served as it is
+    - an expired entry is served while it may be stale, the first request for it
+      gets flagged with needsRevalidation() so a refresh gets started
+    - returns false on a miss, the cache key is kept to store the result of the cgi
+*/
+bool Response::_serveFromCache(Request &request, const Location &location)
+{
+    time_t          now = time(NULL);
+    CgiCacheEntry   *entry;
+
+    if (!location._cgi_cache || request.getMethod() != GET)
+        return false;
+    _cache_key = CgiCache::buildKey(request, location);
+    if (_cache_bypass || (entry = CgiCache::lookup(_cache_key, now)) == NULL)
+        return false;
+    if (now > entry->_expires && !entry->_refreshing)
+    {
+        entry->_refreshing = true;
+        _revalidate = true;
+    }
+    _headers.clear();
+    _headers.insert(entry->_headers.begin(), entry->_headers.end());
+    _headers["Age"] = intToStr(now - entry->_stored);
+    _body = entry->_body;
+    Logger::log(GREY, DEBUG, "Served %s from the CGI cache", request.getPath().c_str());
+    return true;
+}
+
+/*
+hands the result of the cgi to the cache, if the request was looked up in it
+*/
+void Response::_updateCache()
+{
+    if (_cache_key.empty())
+        return ;
+    CgiCache::store(_cache_key, _error, _headers, _body, _cgi->getLocation());
+}
+
 /*
 checks the request for location, allowed_method, redirection, and alias
     calls _checkCgi() -> if no cgi: calls the function to handle the request with right method
 */
-void Response::_handleRequest(Request &request, ServerBlock &server)
+void Response::_handleRequest(Request &request, const ServerBlock &server)
 {
-    std::map<std::string, Location>::iterator location;
+    std::map<std::string, Location>::const_iterator location;
     std::string path = request.getPath();
 
     location = findLocation(path, server._locations);
@@ -546,32 +1193,10 @@ void Response::_handleRequest(Request &request, ServerBlock &server)
         return ;
     }
     // checks if Method is allowed
-    switch (request.getMethod()) {
-
-    case GET:
-        if (location->second._allowed_methods._allow_get == false)
-        {
-            _error = NOT_ALLOWED;
-            return;
-        }
-        break;
-    case POST:
-        if (location->second._allowed_methods._allow_post == false)
-        {
-            _error = NOT_ALLOWED;
-            return;
-        }
-        break;
-    case DELETE:
-        if (location->second._allowed_methods._allow_delete == false)
-        {
-            _error = NOT_ALLOWED;
-            return;
-        }
-        break;
-    default:
-        _error = NOT_IMPLEMENTED;
-        return;
+    if (!isMethodAllowed(request.getMethod(), location->second))
+    {
+        _error = (request.getMethod() == NONE) ? NOT_IMPLEMENTED : NOT_ALLOWED;
+        return ;
     }
 
     // check for redirection
@@ -582,19 +1207,8 @@ void Response::_handleRequest(Request &request, ServerBlock &server)
         return ;
     }
 
-    // add root to path
-    std::string root;
-    root = server._root;
-    root.erase(root.size() - 1, 1);
-    path = root + path;
-
-    // check for alias
-    if (location->second._alias != "")
-    {
-        size_t pos = path.find(root + location->first);
-        if (pos != std::string::npos)
-            path.replace(pos, root.size() + location->first.size(), location->second._alias);
-    }
+    // add root (or alias) to path
+    path = resolvePath(path, server, location);
 
     // check for cgi
     if (_checkCgi(request, server, path, location->second))
@@ -604,20 +1218,62 @@ void Response::_handleRequest(Request &request, ServerBlock &server)
     switch (request.getMethod()) {
 
     case GET:
-        _handleGet(server, path, location->second);
+        _handleGet(request, server, path, location->second);
         break;
     case POST:
+    case PUT:
         _handlePost(request, path, location->second);
         break;
     case DELETE:
         _handleDelete(path);
         break;
+    case HEAD:
+        _handleHead(request, server, path, location->second);
+        break;
     default:
         _error = NOT_IMPLEMENTED;
         return;
     }
 }
 
+/*
+builds the response string out of the status, the headers and the body
+*/
+void Response::_assembleResponse(Request &request, const ServerBlock &server)
+{
+    if (_error >= 400 || _error == CREATED)
+        _buildErrorPage(server);
+    
+    // setting headers
+    if (!_body.empty())
+        _headers.insert(std::make_pair("Content-Length", intToStr(_body.size())));
+    _setConnection(request);
+    _headers.insert(std::make_pair("Server", "Webserv"));
+    _headers.insert(std::make_pair("Date", getCurrentDateTime()));
+    
+    // building response string, it keeps its capacity from the last response of the connection
+    _response.clear();
+
+    // insert header line 
+    _response.append("HTTP/1.1 ").append(intToStr(_error)).append(" ").append(lookupErrorMessage(_error)).append("\r\n");
+
+    // insert headers
+    for (HeaderMap::iterator it = _headers.begin(); it != _headers.end(); it++)
+        _response.append(it->first).append(": ").append(it->second).append("\r\n");
+    _response.append("\r\n");
+
+    // insert body, the response to HEAD only tells its size
+    if (!_body.empty() && request.getMethod() != HEAD)
+        _response.append(_body).append("\r\n");
+
+    if (request.getMethod() == HEAD && _file_fd >= 0)
+    {
+        close(_file_fd);
+        _file_fd = -1;
+        _file_remaining = 0;
+    }
+}
+
 // ======   Public member functions   ======= //
 /*
 looks inside the response headers for "Connection"
@@ -636,13 +1292,46 @@ bool Response::checkConnection()
 
 /*
 clear the response object
+    - the strings keep up to IO_BUFFER_SIZE of their capacity and the arena its first block
+      for the next request, a large response gives its memory back
 */
 void Response::clear()
 {
-    _response = "";
+    _response.clear();
+    if (_response.capacity() > IO_BUFFER_SIZE)
+        std::string().swap(_response);
     _error = OK;
-    _body = "";
+    _body.clear();
+    if (_body.capacity() > IO_BUFFER_SIZE)
+        std::string().swap(_body);
     _headers.clear();
+    delete _cgi;
+    _cgi = NULL;
+    delete _multipart;
+    _multipart = NULL;
+    _cache_key.clear();
+    _cache_bypass = false;
+    _revalidate = false;
+    if (_file_fd >= 0)
+        close(_file_fd);
+    _file_fd = -1;
+    _file_offset = 0;
+    _file_remaining = 0;
+    if (_stream_pipe[0] >= 0)
+    {
+        close(_stream_pipe[0]);
+        close(_stream_pipe[1]);
+    }
+    _stream_pipe[0] = -1;
+    _stream_pipe[1] = -1;
+    _stream_pending = 0;
+    _stream_remaining = -1;
+    _stream_chunked = false;
+    _stream_eof = false;
+    _closeUpload();
+    _upload_status = OK;
+    _upload_offset = 0;
+    _arena.reset();
 }
 
 /*
@@ -653,13 +1342,44 @@ void Response::trimResponse(int bytes_send)
     _response.erase(0, bytes_send);
 }
 
+/*
+sends the next part of the file of the response with sendfile(), the kernel copies it
+straight from the page cache to the socket
+    - returns the number of bytes sent, or -1 on error
+*/
+ssize_t Response::sendFile(int socket_fd)
+{
+    ssize_t bytes_send;
+
+    if (_file_remaining == 0)
+        return 0;
+    bytes_send = sendfile(socket_fd, _file_fd, &_file_offset, std::min(_file_remaining, (size_t)SENDFILE_CHUNK_SIZE));
+    if (bytes_send > 0)
+        _file_remaining -= bytes_send;
+    if (_file_remaining == 0 && _file_fd >= 0)
+    {
+        close(_file_fd);
+        _file_fd = -1;
+    }
+    return bytes_send;
+}
+
+/*
+the response is sent, when nothing of the response string, of the file and of the streamed cgi output is left
+*/
+bool Response::isSent() const
+{
+    return _response.empty() && _file_remaining == 0 && (_stream_pipe[0] < 0 || (_stream_eof && _stream_pending == 0));
+}
+
 /*
 builds the Response for the request of the client
+    - if a cgi got created, the response is finished later by startCgi() and finishCgi()
 */
 void Response::buildResponse(Request &request, sockaddr_in client_addr)
 {
     // getting server block
-    ServerBlock *server = request.getServerBlock();
+    const ServerBlock *server = request.getServerBlock();
 
     if (server == NULL)
         return ;
@@ -668,32 +1388,300 @@ void Response::buildResponse(Request &request, sockaddr_in client_addr)
     _error = request.getError();
     if (_error == OK)
         _handleRequest(request, *server);
+    if (_cgi != NULL)
+        return ;
+    _assembleResponse(request, *server);
+}
 
-    if (_error >= 400 || _error == CREATED)
-        _buildErrorPage(*server);
-    
-    // setting headers
-    if (!_body.empty())
-        _headers.insert(std::make_pair("Content-Length", intToStr(_body.size())));
-    _setConnection(request);
-    _headers.insert(std::make_pair("Server", "Webserv"));
-    _headers.insert(std::make_pair("Date", getCurrentDateTime()));
-    
-    // building response string
-    std::ostringstream oss;
+/*
+creates the cgi for a POST request as soon as its headers are parsed, so the body can be passed on
+to the cgi while it arrives
+    - returns false if the request is not for a cgi (FastCGI gets the whole body),
+      its response is built by buildResponse() once the body is complete
+*/
+bool Response::buildCgi(Request &request, sockaddr_in client_addr)
+{
+    const ServerBlock                                 *server = request.getServerBlock();
+    std::map<std::string, Location>::const_iterator   location;
 
-    // insert header line 
-    oss << "HTTP/1.1 " << _error << " " << lookupErrorMessage(_error) << "\r\n";
+    if (server == NULL || request.getError() != OK || request.getMethod() != POST)
+        return false;
+    location = findLocation(request.getPath(), server->_locations);
+    if (location == server->_locations.end() || !location->second._allowed_methods._allow_post
+        || location->second._redirection != "" || !location->second._fastcgi_pass.empty())
+        return false;
+    _client_addr = client_addr;
+    return _checkCgi(request, *server, resolvePath(request.getPath(), *server, location), location->second);
+}
 
-    // insert headers
-    for (std::map<std::string, std::string>::iterator it = _headers.begin(); it != _headers.end(); it++)
-        oss << it->first << ": " << it->second << "\r\n";
-    oss << "\r\n";
+/*
+prepares the upload of a POST request to an upload location as soon as its headers are parsed,
+so the body gets stored while it arrives:
+    - a multipart body to the upload directory gets a parser, it is fed by feedUpload()
+    - a raw body (POST or PUT) with Content-Length goes around the parser from now on,
+      spliceUpload() moves it from the socket into its file
+    - returns false for any other request, its body is handled by buildResponse()
+*/
+bool Response::buildUpload(Request &request)
+{
+    const ServerBlock                                 *server = request.getServerBlock();
+    std::map<std::string, Location>::const_iterator   location;
+    std::string                                 content_type = request.getHeader(HEADER_CONTENT_TYPE);
+    struct stat                                 file_info;
+    std::string                                 path;
+    bool                                        multipart;
 
-    // insert body
-    if (!_body.empty())
-        oss << _body << "\r\n";
+    if (server == NULL || request.getError() != OK || (request.getMethod() != POST && request.getMethod() != PUT))
+        return false;
+    location = findLocation(request.getPath(), server->_locations);
+    if (location == server->_locations.end() || location->second._redirection != ""
+        || !location->second._fastcgi_pass.empty() || location->second._upload.empty())
+        return false;
+    if (!isMethodAllowed(request.getMethod(), location->second))
+        return false;
+    path = resolvePath(request.getPath(), *server, location);
+    multipart = request.getMethod() == POST && stat(path.c_str(), &file_info) == 0 && S_ISDIR(file_info.st_mode)
+        && content_type.find("multipart/form-data") != std::string::npos;
+    if (multipart && !Multipart::getBoundary(content_type).empty())
+    {
+        _multipart = new Multipart(Multipart::getBoundary(content_type), location->second._upload, location->second._upload_fsync);
+        return true;
+    }
+    if (multipart || request.hasHeader(HEADER_TRANSFER_ENCODING) || request.isBodyEncoded())
+        return false;
+    return _openUpload(request, path, location->second);
+}
+
+/*
+checks a request, whose body did not arrive yet, against its location (Expect: 100-continue)
+    - returns the error it would get for that, or OK
+*/
+int Response::checkRequest(Request &request)
+{
+    const ServerBlock                                 *server = request.getServerBlock();
+    std::map<std::string, Location>::const_iterator   location;
+
+    if (server == NULL)
+        return OK;
+    location = findLocation(request.getPath(), server->_locations);
+    if (location == server->_locations.end())
+        return NOT_FOUND;
+    if (!isMethodAllowed(request.getMethod(), location->second))
+        return NOT_ALLOWED;
+    return OK;
+}
 
-    _response = oss.str();
+/*
+passes the body received so far to the multipart parser and drops it from the request
+*/
+void Response::feedUpload(Request &request)
+{
+    if (_multipart == NULL)
+        return ;
+    _multipart->feed(request.getBody().data(), request.getBody().size());
+    request.trimBody(request.getBody().size());
 }
 
+/*
+moves the next part of a raw upload with splice(): from the socket into the pipe, then from the pipe
+into the file at _upload_offset, the body never gets copied into the server
+    - the request counts the moved bytes as read (see Request::skipBody())
+    - returns the number of bytes moved, 0 if the client closed the connection,
+      or -1 on error (EAGAIN if the socket is not ready)
+*/
+ssize_t Response::spliceUpload(Request &request, int socket_fd)
+{
+    ssize_t bytes;
+    ssize_t moved;
+    ssize_t n;
+
+    bytes = splice(socket_fd, NULL, _upload_pipe[1], NULL, std::min(request.getRemainingBody(), (size_t)UPLOAD_SPLICE_SIZE), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (bytes <= 0)
+        return bytes;
+    for (moved = 0; moved < bytes; moved += n)
+    {
+        if ((n = splice(_upload_pipe[0], NULL, _upload_fd, &_upload_offset, bytes - moved, SPLICE_F_MOVE)) <= 0)
+        {
+            Logger::log(RED, ERROR, "Writing the upload to %s failed: %s", _upload_path.c_str(), strerror(errno));
+            errno = EIO;
+            return -1;
+        }
+    }
+    request.skipBody(bytes);
+    return bytes;
+}
+
+/*
+true while the body of a raw upload is spliced into its file
+*/
+bool Response::isUploading() const
+{
+    return _upload_fd >= 0;
+}
+
+/*
+starts the cgi created by buildResponse() (or buildCgi()), the response gets finished by finishCgi()
+    - returns false if the cgi could not be started, the response is built with the error instead
+*/
+bool Response::startCgi(Request &request)
+{
+    _cgi->execCgi();
+    if (_cgi->getError() == OK)
+        return true;
+    _error = _cgi->getError();
+    _updateCache();
+    delete _cgi;
+    _cgi = NULL;
+    _assembleResponse(request, *request.getServerBlock());
+    return false;
+}
+
+/*
+drops the cgi which got no slot at its location and builds a 503 Response,
+Retry-After tells the client when to try again
+*/
+void Response::rejectCgi(Request &request, size_t retry_after)
+{
+    _error = SERVICE_UNAVAILABLE;
+    _updateCache();
+    delete _cgi;
+    _cgi = NULL;
+    _headers["Retry-After"] = intToStr(retry_after);
+    _assembleResponse(request, *request.getServerBlock());
+}
+
+/*
+builds the Response out of the result the cgi of another, identical request (the leader) produced,
+instead of running an own cgi
+*/
+void Response::shareCgi(Request &request, const Response &leader)
+{
+    delete _cgi;
+    _cgi = NULL;
+    _error = leader._error;
+    _body = leader._body;
+    _headers = leader._headers;
+    _headers.erase("Connection");
+    _assembleResponse(request, *request.getServerBlock());
+}
+
+/*
+takes over the result of the finished cgi and builds the Response
+*/
+void Response::finishCgi(Request &request)
+{
+    _cgi->finish();
+    _body = _cgi->getBody();
+    _headers.insert(_cgi->getHeaders().begin(), _cgi->getHeaders().end());
+    if (_cgi->getError() != OK)
+        _error = _cgi->getError();
+    _updateCache();
+    _checkSendfile(request);
+    delete _cgi;
+    _cgi = NULL;
+    _assembleResponse(request, *request.getServerBlock());
+}
+
+/*
+streams the rest of the cgi output to the client, once its header block is complete (cgi_stream on):
+    - the headers become the response string, the body gets moved by spliceCgi() from the output
+      of the cgi through a pipe to the socket, it never gets copied into the server
+    - without Content-Length of the cgi the body is sent chunked (HTTP/1.0: until the connection closes)
+    - error statuses, X-Sendfile and responses for the cgi cache are collected as before
+    - returns true if the response is streamed from now on
+*/
+bool Response::streamCgi(Request &request)
+{
+    if (!_cgi->getLocation()._cgi_stream || !_cache_key.empty() || request.getMethod() == HEAD || !_cgi->parseHeaders())
+        return false;
+
+    const std::map<std::string, std::string>    &headers = _cgi->getHeaders();
+    std::string                                 body = _cgi->getBody();
+    int                                         error = _cgi->getError();
+
+    if (error >= 400 || error == CREATED || headers.count("X-Accel-Redirect") || headers.count("X-Sendfile"))
+        return false;
+    if (pipe2(_stream_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        Logger::log(RED, ERROR, "Creating the pipe to stream the CGI output failed: %s", strerror(errno));
+        _stream_pipe[0] = -1;
+        _stream_pipe[1] = -1;
+        return false;
+    }
+    _error = error;
+    _headers.insert(headers.begin(), headers.end());
+    if (_headers.count("Content-Length"))
+    {
+        _stream_remaining = strtoll(_headers["Content-Length"].c_str(), NULL, 10);
+        if (body.size() > (size_t)_stream_remaining)
+            body.erase(_stream_remaining);
+        _stream_remaining -= body.size();
+    }
+    else if (request.getVersionMajor() == 1 && request.getVersionMinor() >= 1)
+    {
+        _headers["Transfer-Encoding"] = "chunked";
+        _stream_chunked = true;
+    }
+    else
+        _headers["Connection"] = "close";
+    _assembleResponse(request, *request.getServerBlock());
+    if (!body.empty())
+        _response += _stream_chunked ? sizeToHex(body.size()) + "\r\n" + body + "\r\n" : body;
+    _stream_eof = (_stream_remaining == 0);
+    Logger::log(GREY, DEBUG, "Streaming the CGI output of %s", request.getPath().c_str());
+    return true;
+}
+
+/*
+moves the next part of the streamed cgi output with splice(): from the output of the cgi into the pipe,
+then from the pipe to the socket, with the chunk size and the end of the chunk in the response string
+    - returns the number of bytes moved, 0 at the end of the output,
+      or -1 on error (EAGAIN if the cgi or the socket is not ready)
+*/
+ssize_t Response::spliceCgi(int socket_fd)
+{
+    ssize_t bytes;
+    size_t  len = CGI_STREAM_CHUNK_SIZE;
+
+    if (_stream_pending > 0)
+    {
+        bytes = splice(_stream_pipe[0], NULL, socket_fd, NULL, _stream_pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (bytes > 0 && (_stream_pending -= bytes) == 0 && _stream_chunked)
+            _response = "\r\n";
+        return bytes;
+    }
+    if (_stream_eof)
+        return 0;
+    if (_stream_remaining >= 0 && (size_t)_stream_remaining < len)
+        len = _stream_remaining;
+    bytes = splice(_cgi->getOutputFd(), NULL, _stream_pipe[1], NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (bytes < 0)
+        return -1;
+    if (bytes == 0)
+    {
+        if (_stream_remaining > 0)
+        {
+            Logger::log(RED, ERROR, "CGI output ended before its Content-Length");
+            errno = EPIPE;
+            return -1;
+        }
+        _stream_eof = true;
+        if (_stream_chunked)
+            _response = "0\r\n\r\n";
+        return 0;
+    }
+    _stream_pending = bytes;
+    if (_stream_remaining >= 0 && (_stream_remaining -= bytes) == 0)
+        _stream_eof = true;
+    if (_stream_chunked)
+        _response = sizeToHex(bytes) + "\r\n";
+    return bytes;
+}
+
+/*
+the response is streamed from the output of the cgi (see streamCgi())
+*/
+bool Response::isStreaming() const
+{
+    return _stream_pipe[0] >= 0;
+}
@@ -1,26 +1,37 @@
 #include "../inc/ServerManager.hpp"
 
+volatile sig_atomic_t   ServerManager::_reload_requested = 0;
+
 // =============   Constructor   ============= //
 ServerManager::ServerManager()
 {
+    _config = NULL;
     _epoll_fd = 0;
+    _background_fd = -1;
 }
 
 // ============   Deconstructor   ============ //
 ServerManager::~ServerManager()
 {
+    for (size_t i = 0; i < _spares.size(); i++)
+    {
+        delete _spares[i].first;
+        delete _spares[i].second;
+    }
+    if (_config != NULL)
+        _config->release();
 }
 
 // ================   Utils   ================ //
 /*
-adds the add_fd to the epoll instance for EPOLLIN events
+adds the add_fd to the epoll instance for the given events (EPOLLIN by default)
     - on success, zero is returned
     - on error, -1 is returned, and errno is set to indicate the error.
 */
-static int    addToEpollInstance(int epoll_fd, int add_fd)
+static int    addToEpollInstance(int epoll_fd, int add_fd, uint32_t events = EPOLLIN)
 {
     struct epoll_event event;
-    event.events = EPOLLIN; 
+    event.events = events; 
     event.data.fd = add_fd;
     if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, add_fd, &event) == -1)
         return -1;
@@ -64,9 +75,6 @@ void    ServerManager::_acceptNewConnection(int socket_fd)
     client._client_address = client.socket->getSocketAddress();
     client._last_msg_time = time(NULL);
 
-    client.request.setSocket(client.socket);
-    client.request.setServerBlocks(_server_blocks);
-
     //  adding client_fd to epoll instance 
     if (addToEpollInstance(_epoll_fd, client._client_fd) < 0)
     {
@@ -84,37 +92,112 @@ void    ServerManager::_acceptNewConnection(int socket_fd)
 
 /*
 closes connection:
+    - removing the fds of a running cgi from the epoll instance (the cgi gets killed with the response)
+    - freeing its slot or place in the queue of the location
+    - removing it from coalesced requests
     - removing the client_fd fromt the epoll instance
-    - closing the client_fd
+    - closing the client_fd (a background client has none)
     - removing the client from the client_map
 */
 void    ServerManager::_closeConnection(int fd)
 {
+    CgiHandler *cgi = _client_map.count(fd) && _client_map[fd].response != NULL ? _client_map[fd].response->getCgi() : NULL;
+
+    if (cgi != NULL)
+    {
+        _removeCgiFd(cgi->getInputFd());
+        _removeCgiFd(cgi->getOutputFd());
+        _removeCgiFd(cgi->getPidFd());
+    }
+    _releaseCgi(fd);
+    _uncoalesceCgi(fd);
+    if (_client_map.count(fd))
+        _detachState(_client_map[fd]);
+    _client_map.erase(fd);
+    if (fd < 0)
+        return ;
     if (epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, NULL) < 0)
         Logger::log(RED, ERROR, "Deleting fd[%i] from epoll instance failed: %s", fd, strerror(errno));
     if (close(fd))
         Logger::log(RED, ERROR, "Closing fd[%i] failed: %s", fd, strerror(errno));
-    _client_map.erase(fd);
     Logger::log(CYAN, INFO, "Closed connection on fd[%i]", fd);
 }
 
 /*
-checking for timeouts of all clients in the _client_map
+changes the events the client_fd waits for in the epoll instance, closes the connection on error
+    - a background client (negative fd) has no connection: as soon as its response
+      is ready (EPOLLOUT) it is done and gets removed
+*/
+void    ServerManager::_setClientEvents(int fd, uint32_t events)
+{
+    struct epoll_event  event;
+
+    if (fd < 0)
+    {
+        if (events & EPOLLOUT)
+            _closeConnection(fd);
+        return ;
+    }
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, fd, &event))
+    {
+        Logger::log(RED, ERROR, "Changing settings associated with fd[%i] in epoll instance failed", fd);
+        _closeConnection(fd);
+    }
+}
+
+/*
+checking for timeouts of all clients in the _client_map:
+    - clients waiting for a cgi are limited by the cgi_timeout instead
+    - clients getting a streamed cgi response or still sending the body to their cgi
+      only time out, if nothing moved for a while
+    - clients waiting too long in the queue of a location get a 503
+    - cgi processes without pidfd get reaped here
+    - killed cgi processes of closed connections get reaped
 */
 void    ServerManager::_checkTimeout()
 {
-    std::vector<int> timeouts;
+    std::vector<int>    timeouts;
+    std::vector<int>    finished_cgis;
+    std::vector<int>    queue_timeouts;
+    time_t              now = time(NULL);
+
+    for (size_t i = 0; i < _cgi_queues.size(); i++)
+    {
+        std::deque<std::pair<int, time_t> > &waiting = _cgi_queues[i]._waiting;
 
+        for (size_t j = 0; j < waiting.size() && waiting[j].second < now; j++)
+            queue_timeouts.push_back(waiting[j].first);
+    }
+    for (size_t i = 0; i < queue_timeouts.size(); i++)
+    {
+        Logger::log(YELLOW, INFO, "Client fd[%i] waited too long for a CGI slot", queue_timeouts[i]);
+        _rejectCgi(_client_map[queue_timeouts[i]], _cgi_queues[_cgi_queue_map[queue_timeouts[i]]]._timeout);
+    }
     for (std::map<int, Client>::iterator it = _client_map.begin(); it != _client_map.end(); it++)
     {
-        if (time(NULL) - it->second._last_msg_time > CLIENT_CONNECTION_TIMEOUT)
+        CgiHandler  *cgi = it->second.response != NULL ? it->second.response->getCgi() : NULL;
+        bool        streaming = it->second.response != NULL && (it->second.response->isStreaming() || it->second.request->isReadingBody());
+
+        if (cgi != NULL && cgi->isStarted() && !streaming)
+        {
+            if (cgi->getPidFd() < 0)
+                cgi->reap();
+            if (cgi->checkTimeout(now) || cgi->isFinished())
+                finished_cgis.push_back(it->first);
+        }
+        else if ((cgi == NULL || streaming) && now - it->second._last_msg_time > CLIENT_CONNECTION_TIMEOUT)
             timeouts.push_back(it->first);
     }
+    for (size_t i = 0; i < finished_cgis.size(); i++)
+        _finishCgi(_client_map[finished_cgis[i]]);
     for (size_t i = 0; i < timeouts.size(); i++)
     {
         Logger::log(CYAN, INFO, "Client timeout: Client_FD[%i], closing connection ...", timeouts[i]);
         _closeConnection(timeouts[i]);
     }
+    CgiHandler::reapOrphans();
 }
 
 /*
@@ -124,11 +207,14 @@ void ServerManager::_findDefaultServer(Client &client)
 {
     if (client.socket == NULL)
         return ;
-    for (size_t i  = 0; i < _server_blocks.size(); i++)
+
+    const std::vector<ServerBlock>  &server_blocks = client.request->getConfig()->getServerBlocks();
+
+    for (size_t i  = 0; i < server_blocks.size(); i++)
     {
-        if (_server_blocks[i]._host == client.socket->getHost() && _server_blocks[i]._port == client.socket->getPort())
+        if (server_blocks[i]._host == client.socket->getHost() && server_blocks[i]._port == client.socket->getPort())
         {
-            client.request.setServerBlock(&_server_blocks[i]);
+            client.request->setServerBlock(&server_blocks[i]);
             return ;
         }
     }
@@ -138,16 +224,29 @@ void ServerManager::_findDefaultServer(Client &client)
 Reading of the HTTP Request:
     - reading READ_SIZE amount of octest from the client into an buffer
     - parsing the buffer into an HttpRequest object
+    - a POST request to a cgi starts the cgi as soon as the headers are parsed: a body with
+      Content-Length is streamed into it while it arrives, a chunked or compressed body is spilled into a file
+      (the cgi needs CONTENT_LENGTH up front) and the cgi starts when it is complete
+    - a multipart upload gets parsed while it arrives, its files are written right away
+    - a raw upload with Content-Length is spliced from the socket into its file, around the parser
+    - Expect: 100-continue is answered right after the headers (see _sendContinue())
     - set epoll settings to EPOLLOUT on client_fd if recieved full request
 */
 void    ServerManager::_readRequest(Client &client)
 {
-    uint8_t buffer[REQUEST_READ_SIZE];
-    int     bytes_read = 0;
-    int     fd = client._client_fd;
+    uint8_t         buffer[REQUEST_READ_SIZE];
+    int             bytes_read = 0;
+    int             fd = client._client_fd;
+    bool            reading_body = client.request != NULL && client.request->isReadingBody();
+    bool            uploading = client.response != NULL && client.response->isUploading();
 
-    // reading request
-    bytes_read = read(fd, buffer, REQUEST_READ_SIZE);
+    // reading request, the body of a raw upload goes from the socket straight into its file
+    if (uploading)
+        bytes_read = client.response->spliceUpload(*client.request, fd);
+    else
+        bytes_read = read(fd, buffer, REQUEST_READ_SIZE);
+    if (bytes_read < 0 && errno == EAGAIN)
+        return ;
     if (bytes_read == 0)
     {
         Logger::log(CYAN, INFO, "Client fd[%i] closed connection", fd);
@@ -163,23 +262,69 @@ void    ServerManager::_readRequest(Client &client)
     else
     {
         client._last_msg_time = time(NULL);
-        client.request.parse(buffer, bytes_read);
-        std::memset(buffer, 0, sizeof(buffer));
+        if (client.request == NULL)
+            _attachState(client);
+        if (!uploading)
+            client.request->parse(buffer, bytes_read);
+    }
+
+    // the body goes on to the cgi which is running already
+    CgiHandler  *cgi = client.response->getCgi();
+
+    if (cgi != NULL && cgi->isStarted())
+    {
+        if (client.request->getError() != OK)
+        {
+            Logger::log(RED, ERROR, "Invalid body sent to the CGI by client fd[%i]", fd);
+            _closeConnection(fd);
+            return ;
+        }
+        if (client.request->getParsingState() == Parsing_Finished)
+        {
+            Logger::log(GREEN, INFO, "Request received from client fd[%i] with method[%s] and URI[%s]", fd, client.request->getMethodStr().c_str(), client.request->getPath().c_str());
+            cgi->restartTimeout();
+        }
+        _streamBody(client);
+        return ;
     }
 
+    // a client waiting for 100 (Continue) gets it, or the error of the request, before it sends the body
+    if (!reading_body && client.request->isReadingBody() && client.request->expectsContinue())
+        _sendContinue(client);
+
+    // the parts of a multipart upload get written to their files while the body arrives
+    client.response->feedUpload(*client.request);
+
+    // a body which is not streamed into a cgi or an upload gets spooled to a file, once it outgrows client_body_buffer_size
+    if (cgi == NULL && client.request->getBodyFd() < 0 && client.request->getServerBlock() != NULL
+        && client.request->getBody().size() > client.request->getServerBlock()->_client_body_buffer_size)
+        client.request->spillBody();
+
     // checking if request is fully read
-    if (client.request.getParsingState() == Parsing_Finished || client.request.getError() != OK)
+    if (client.request->getParsingState() == Parsing_Finished || client.request->getError() != OK)
     {
-        Logger::log(GREEN, INFO, "Request received from client fd[%i] with method[%s] and URI[%s]", fd, client.request.getMethodStr().c_str(), client.request.getPath().c_str());
-        if (client.request.getServerBlock() == NULL)
+        Logger::log(GREEN, INFO, "Request received from client fd[%i] with method[%s] and URI[%s]", fd, client.request->getMethodStr().c_str(), client.request->getPath().c_str());
+        if (client.request->getServerBlock() == NULL)
             _findDefaultServer(client);
-        if (client.request.getServerBlock() == NULL)
+        if (client.request->getServerBlock() == NULL)
         {
             Logger::log(RED, ERROR, "Could not find an Server to serve with on fd[%i]", fd);
             _closeConnection(fd);
             return ;
         }
-        client.response.buildResponse(client.request, client._client_address);
+        // the cgi for a chunked body exists already, unless the body turned out invalid
+        if (cgi != NULL && client.request->getError() != OK)
+            client.response->clear();
+        if (client.response->getCgi() == NULL)
+            client.response->buildResponse(*client.request, client._client_address);
+        if (client.response->needsRevalidation())
+            _revalidateCgi(client);
+        if (client.response->getCgi() != NULL)
+        {
+            if (!_coalesceCgi(client))
+                _admitCgi(client);
+            return ;
+        }
         Logger::log(GREY, DEBUG, "Finished response building");
         struct epoll_event event;
 
@@ -192,60 +337,803 @@ void    ServerManager::_readRequest(Client &client)
             return ;
         }
     }
+    // the headers of a request with a body just got parsed
+    else if (!reading_body && client.request->isReadingBody()
+        && client.response->buildCgi(*client.request, client._client_address))
+    {
+        // a chunked or compressed body gets spilled (it stays in memory, if that fails)
+        if (client.request->hasHeader(HEADER_TRANSFER_ENCODING) || client.request->isBodyEncoded())
+            client.request->spillBody();
+        else
+            _admitCgi(client);
+    }
+    else if (!reading_body && client.request->isReadingBody() && client.response->buildUpload(*client.request))
+        client.response->feedUpload(*client.request);
+}
+
+/*
+answers Expect: 100-continue as soon as the headers are parsed:
+    - a request its location rejects gets the error right away and the connection gets closed,
+      its body is never sent (413 and 417 are found by the parser already)
+    - otherwise "100 Continue" tells the client to send the body
+*/
+void    ServerManager::_sendContinue(Client &client)
+{
+    static const char   response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    int                 error = client.response->checkRequest(*client.request);
+
+    if (error != OK)
+    {
+        client.request->setError(error);
+        return ;
+    }
+    if (write(client._client_fd, response, sizeof(response) - 1) != (ssize_t)sizeof(response) - 1)
+        Logger::log(YELLOW, INFO, "Sending 100 Continue to client fd[%i] failed", client._client_fd);
+}
+
+/*
+refreshes a stale entry of the cgi cache, while the client gets the stale response:
+    - a copy of the client with a negative fd (a background client without connection)
+      runs the cgi again, bypassing the cache
+    - it goes through _admitCgi() like every cgi, its result replaces the cache entry
+*/
+void    ServerManager::_revalidateCgi(Client &client)
+{
+    int     fd = _background_fd--;
+    Client  &background = _client_map.insert(std::make_pair(fd, client)).first->second;
+
+    background._client_fd = fd;
+    background.response->clear();
+    background.response->bypassCache();
+    background.response->buildResponse(*background.request, background._client_address);
+    if (background.response->getCgi() == NULL)
+    {
+        _client_map.erase(fd);
+        return ;
+    }
+    Logger::log(GREY, DEBUG, "Refreshing cached response for %s in the background", background.request->getPath().c_str());
+    _admitCgi(background);
+}
+
+/*
+coalesces identical GET requests to the cgi of a location with cgi_coalesce:
+    - the first request (the leader) runs the cgi, requests with the same key arriving
+      meanwhile wait for its result instead of starting their own cgi
+    - the key is the one of the cgi cache (method, host, path, query and cgi_cache_key_headers)
+    - returns true if the client got parked behind a leader
+*/
+bool    ServerManager::_coalesceCgi(Client &client)
+{
+    const Location  &location = client.response->getCgi()->getLocation();
+    int             fd = client._client_fd;
+
+    if (!location._cgi_coalesce || client.request->getMethod() != GET)
+        return false;
+
+    std::string         key = CgiCache::buildKey(*client.request, location);
+    std::vector<int>    &clients = _coalesced[key];
+
+    clients.push_back(fd);
+    _coalesced_keys[fd] = key;
+    if (clients.size() == 1)
+        return false;
+    Logger::log(GREY, DEBUG, "Client fd[%i] waits for the identical CGI request of client fd[%i]", fd, clients.front());
+    _setClientEvents(fd, EPOLLRDHUP);
+    return true;
+}
+
+/*
+answers the clients waiting for the cgi of the leader with its response
+*/
+void    ServerManager::_shareCgi(Client &leader)
+{
+    std::map<int, std::string>::iterator it = _coalesced_keys.find(leader._client_fd);
+
+    if (it == _coalesced_keys.end())
+        return ;
+
+    std::string         key = it->second;
+    std::vector<int>    clients = _coalesced[key];
+
+    _coalesced.erase(key);
+    for (size_t i = 0; i < clients.size(); i++)
+        _coalesced_keys.erase(clients[i]);
+    for (size_t i = 1; i < clients.size(); i++)
+    {
+        Client &client = _client_map[clients[i]];
+
+        client.response->shareCgi(*client.request, *leader.response);
+        _setClientEvents(clients[i], EPOLLOUT);
+    }
+    if (clients.size() > 1)
+        Logger::log(GREY, DEBUG, "Shared CGI response of client fd[%i] with %i clients", leader._client_fd, (int)clients.size() - 1);
+}
+
+/*
+removes a closed client from the coalesced requests
+    - if it was the leader, the next client starts the cgi instead
+*/
+void    ServerManager::_uncoalesceCgi(int fd)
+{
+    std::map<int, std::string>::iterator it = _coalesced_keys.find(fd);
+
+    if (it == _coalesced_keys.end())
+        return ;
+
+    std::string         key = it->second;
+    std::vector<int>    &clients = _coalesced[key];
+    bool                leader = (clients.front() == fd);
+
+    _coalesced_keys.erase(it);
+    clients.erase(std::find(clients.begin(), clients.end(), fd));
+    if (clients.empty())
+        _coalesced.erase(key);
+    else if (leader)
+        _admitCgi(_client_map[clients.front()]);
+}
+
+/*
+admits the cgi of the client under the cgi_max_concurrency of its location:
+    - it is started right away, if the location has a free slot
+    - otherwise the client waits in the FIFO queue of the location, until a running cgi finishes
+      (at most cgi_queue timeout seconds, the client_fd only waits for a hangup meanwhile)
+    - a full queue is answered with 503 and Retry-After, instead of overloading the machine
+*/
+void    ServerManager::_admitCgi(Client &client)
+{
+    const Location      &location = client.response->getCgi()->getLocation();
+    int                 fd = client._client_fd;
+
+    if (location._cgi_max_concurrency == 0)
+    {
+        _startCgi(client);
+        return ;
+    }
+
+    CgiQueue &queue = _cgi_queues[location._cgi_queue_id];
+
+    if (queue._running < queue._max_concurrency)
+    {
+        queue._running++;
+        _cgi_queue_map[fd] = location._cgi_queue_id;
+        _startCgi(client);
+        return ;
+    }
+    if (queue._waiting.size() >= queue._size)
+    {
+        Logger::log(YELLOW, INFO, "CGI queue is full, rejecting client fd[%i]", fd);
+        _rejectCgi(client, queue._timeout);
+        return ;
+    }
+    queue._waiting.push_back(std::make_pair(fd, time(NULL) + queue._timeout));
+    _cgi_queue_map[fd] = location._cgi_queue_id;
+    Logger::log(GREY, DEBUG, "Client fd[%i] waits for a CGI slot (%i queued)", fd, (int)queue._waiting.size());
+
+    _setClientEvents(fd, EPOLLRDHUP);
+}
+
+/*
+answers a client that got no cgi slot with 503 and sets epoll settings on client_fd to EPOLLOUT
+*/
+void    ServerManager::_rejectCgi(Client &client, size_t retry_after)
+{
+    int fd = client._client_fd;
+
+    _releaseCgi(fd);
+    client.response->rejectCgi(*client.request, retry_after);
+    _shareCgi(client);
+    _setClientEvents(fd, EPOLLOUT);
+}
+
+/*
+frees the slot (or the place in the queue) the client has at the location of its cgi
+    - a freed slot goes to the first client in the queue
+*/
+void    ServerManager::_releaseCgi(int fd)
+{
+    std::map<int, size_t>::iterator it = _cgi_queue_map.find(fd);
+
+    if (it == _cgi_queue_map.end())
+        return ;
+
+    CgiQueue &queue = _cgi_queues[it->second];
+
+    _cgi_queue_map.erase(it);
+    for (std::deque<std::pair<int, time_t> >::iterator waiting = queue._waiting.begin(); waiting != queue._waiting.end(); waiting++)
+    {
+        if (waiting->first == fd)
+        {
+            queue._waiting.erase(waiting);
+            return ;
+        }
+    }
+    queue._running--;
+    while (!queue._waiting.empty() && queue._running < queue._max_concurrency)
+    {
+        int next = queue._waiting.front().first;
+
+        queue._waiting.pop_front();
+        queue._running++;
+        _startCgi(_client_map[next]);
+    }
+}
+
+/*
+starts the cgi and registers its fds in the epoll instance:
+    - stdin of the cgi for EPOLLOUT, its output and its pidfd for EPOLLIN
+    - the client_fd only waits for a hangup, until the response is ready
+    - if the cgi could not be started, the error response gets sent right away
+*/
+void    ServerManager::_startCgi(Client &client)
+{
+    CgiHandler          *cgi = client.response->getCgi();
+    int                 fd = client._client_fd;
+
+    if (!client.response->startCgi(*client.request))
+    {
+        _releaseCgi(fd);
+        _shareCgi(client);
+        _setClientEvents(fd, EPOLLOUT);
+        return ;
+    }
+    if ((cgi->getInputFd() >= 0 && addToEpollInstance(_epoll_fd, cgi->getInputFd(), EPOLLOUT) < 0)
+        || addToEpollInstance(_epoll_fd, cgi->getOutputFd()) < 0
+        || (cgi->getPidFd() >= 0 && addToEpollInstance(_epoll_fd, cgi->getPidFd()) < 0))
+    {
+        Logger::log(RED, ERROR, "adding cgi fds of client fd[%i] to epoll instance failed", fd);
+        _closeConnection(fd);
+        return ;
+    }
+    if (cgi->getInputFd() >= 0)
+        _cgi_fd_map[cgi->getInputFd()] = fd;
+    _cgi_fd_map[cgi->getOutputFd()] = fd;
+    if (cgi->getPidFd() >= 0)
+        _cgi_fd_map[cgi->getPidFd()] = fd;
+
+    if (client.request->isReadingBody())
+        _streamBody(client);
+    else
+        _setClientEvents(fd, EPOLLRDHUP);
+}
+
+/*
+passes the request body on to the stdin of the cgi while it still arrives, with flow control:
+    - the stdin of the cgi waits for EPOLLOUT only while there is something to write
+      (or the end of the body to signal), otherwise it would wake up the loop over and over
+    - the client_fd is only read while less than CGI_BODY_BUFFER_SIZE of the body wait
+      for the cgi, so a slow cgi slows the client down instead of filling the memory
+    - once the cgi closed its stdin, the rest of the body is read and dropped
+*/
+void    ServerManager::_streamBody(Client &client)
+{
+    CgiHandler  *cgi = client.response->getCgi();
+    int         fd = client._client_fd;
+    int         in_fd = cgi->getInputFd();
+    bool        pending = !client.request->getBody().empty() || !client.request->isReadingBody();
+
+    if (in_fd < 0)
+        client.request->trimBody(client.request->getBody().size());
+    else if (pending && _cgi_fd_map.count(in_fd) == 0)
+    {
+        if (addToEpollInstance(_epoll_fd, in_fd, EPOLLOUT) < 0)
+        {
+            Logger::log(RED, ERROR, "adding cgi fd[%i] to epoll instance failed", in_fd);
+            _closeConnection(fd);
+            return ;
+        }
+        _cgi_fd_map[in_fd] = fd;
+    }
+    else if (!pending)
+        _removeCgiFd(in_fd);
+    if (!client.request->isReadingBody())
+        _setClientEvents(fd, EPOLLRDHUP);
+    else if (client.request->getBody().size() < CGI_BODY_BUFFER_SIZE)
+        _setClientEvents(fd, EPOLLIN);
+    else
+        _setClientEvents(fd, EPOLLRDHUP);
+}
+
+/*
+handles an event on one of the fds of a running cgi:
+    - writes the request body into the stdin of the cgi
+    - reads the output of the cgi, or streams it to the client once the headers are complete
+    - reaps the cgi process when its pidfd gets readable
+    - finishes the response, when the cgi is done
+*/
+void    ServerManager::_handleCgiEvent(int fd)
+{
+    Client      &client = _client_map[_cgi_fd_map[fd]];
+    CgiHandler  *cgi = client.response->getCgi();
+    bool        done = false;
+
+    if (fd == cgi->getInputFd())
+    {
+        done = cgi->writeInput();
+        client._last_msg_time = time(NULL);
+        // the body is still arriving: nothing more to write for now
+        if (!done && client.request->isReadingBody())
+        {
+            _streamBody(client);
+            return ;
+        }
+    }
+    else if (fd == cgi->getOutputFd() && client.response->isStreaming())
+    {
+        _streamCgi(client);
+        return ;
+    }
+    else if (fd == cgi->getOutputFd())
+    {
+        done = cgi->readOutput();
+        // the response of coalesced requests and of background clients gets shared or cached,
+        // a client still sending its body is not written to yet
+        if (!done && client._client_fd >= 0 && _coalesced_keys.count(client._client_fd) == 0
+            && !client.request->isReadingBody() && client.response->streamCgi(*client.request))
+        {
+            _startStream(client);
+            return ;
+        }
+    }
+    else if (fd == cgi->getPidFd())
+        done = cgi->reap();
+    if (done)
+    {
+        _removeCgiFd(fd);
+        cgi->closeFd(fd);
+    }
+    if (cgi->isFinished())
+        _finishCgi(client);
+}
+
+/*
+removes the remaining fds of the cgi from the epoll instance, frees its slot, builds the response
+(also for the coalesced clients) and sets epoll settings on client_fd to EPOLLOUT
+*/
+void    ServerManager::_finishCgi(Client &client)
+{
+    CgiHandler          *cgi = client.response->getCgi();
+    int                 fd = client._client_fd;
+
+    _removeCgiFd(cgi->getInputFd());
+    _removeCgiFd(cgi->getOutputFd());
+    _removeCgiFd(cgi->getPidFd());
+    client.response->finishCgi(*client.request);
+    _releaseCgi(fd);
+    _shareCgi(client);
+    Logger::log(GREY, DEBUG, "Finished response building");
+
+    _setClientEvents(fd, EPOLLOUT);
+}
+
+/*
+switches the client to the streamed response of its cgi, after streamCgi() took over the output:
+    - the client_fd waits for EPOLLOUT and the output of the cgi for EPOLLIN, both edge-triggered:
+      whichever of them gets ready again resumes _streamCgi(), and the one which is not
+      needed meanwhile does not wake up the event loop over and over
+*/
+void    ServerManager::_startStream(Client &client)
+{
+    struct epoll_event  event;
+    int                 fd = client._client_fd;
+
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = client.response->getCgi()->getOutputFd();
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, event.data.fd, &event))
+    {
+        Logger::log(RED, ERROR, "Changing settings associated with cgi fd[%i] in epoll instance failed", event.data.fd);
+        _closeConnection(fd);
+        return ;
+    }
+    _setClientEvents(fd, EPOLLOUT | EPOLLET);
+}
+
+/*
+sends the streamed cgi response: the response string (headers and chunk framing) gets written,
+the body gets spliced by the response from the output of the cgi to the client_fd
+    - runs until the client_fd or the cgi would block
+    - once the body is complete, the cgi is done: its fds are removed, its slot is freed
+*/
+void    ServerManager::_streamCgi(Client &client)
+{
+    CgiHandler  *cgi = client.response->getCgi();
+    int         fd = client._client_fd;
+    ssize_t     bytes;
+    bool        header;
+
+    client._last_msg_time = time(NULL);
+    while (!client.response->isSent())
+    {
+        const std::string &response = client.response->getResponse();
+
+        header = !response.empty();
+        if (header)
+            bytes = write(fd, response.c_str(), response.size());
+        else
+            bytes = client.response->spliceCgi(fd);
+        if (bytes < 0 && errno == EAGAIN)
+            return ;
+        if (bytes < 0)
+        {
+            Logger::log(CYAN, INFO, "Could not stream the CGI output to fd[%i]: %s", fd, strerror(errno));
+            _closeConnection(fd);
+            return ;
+        }
+        if (header)
+            client.response->trimResponse(bytes);
+    }
+    _removeCgiFd(cgi->getInputFd());
+    _removeCgiFd(cgi->getOutputFd());
+    _removeCgiFd(cgi->getPidFd());
+    _releaseCgi(fd);
+    _endResponse(client);
+}
+
+/*
+removes an fd of a cgi from the epoll instance and the cgi_fd_map
+*/
+void    ServerManager::_removeCgiFd(int fd)
+{
+    if (fd < 0 || _cgi_fd_map.count(fd) == 0)
+        return ;
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, NULL) < 0)
+        Logger::log(RED, ERROR, "Deleting cgi fd[%i] from epoll instance failed: %s", fd, strerror(errno));
+    _cgi_fd_map.erase(fd);
 }
 
 /*
 sending the Response to the client:
     - write RESPONSE_WRITE_SIZE of the response to client_fd until full response is send
     - triming the response the amount which got send to the client
-    - checking if connection should be "keep-alive"
-    - set epoll settings on client_fd to EPOLLIN
-    - clearing reuquest and response objects of the client
+    - then the file of the response (if any) is sent with sendfile()
+    - a streamed cgi response is sent by _streamCgi()
 */
 void    ServerManager::_sendResponse(Client &client)
 {
     int bytes_send = 0;
     int fd = client._client_fd;
 
-    const std::string &response = client.response.getResponse();
+    if (client.response->isStreaming())
+    {
+        _streamCgi(client);
+        return ;
+    }
+
+    const std::string &response = client.response->getResponse();
 
     // sending response to client_fd 
     if (response.size() >= RESPONSE_WRITE_SIZE)
         bytes_send = write(fd, response.c_str(), RESPONSE_WRITE_SIZE);
-    else
+    else if (!response.empty())
         bytes_send = write(fd, response.c_str(), response.size());
+    else
+        bytes_send = client.response->sendFile(fd);
+    if (bytes_send < 0 && errno == EAGAIN)
+        return ;
     if (bytes_send < 0)
     {
         Logger::log(CYAN, INFO, "Could not write on fd[%i]: client closed Connection", fd);
         _closeConnection(fd);
         return ;
     }
+    if (!response.empty())
+        client.response->trimResponse(bytes_send);
+    else if (bytes_send == 0 && !client.response->isSent())
+    {
+        Logger::log(RED, ERROR, "File of the response on fd[%i] got shorter while sending it", fd);
+        _closeConnection(fd);
+        return ;
+    }
 
     // checking if full response got send
-    if (bytes_send == 0 || (size_t)bytes_send == response.size())
+    if (bytes_send == 0 || client.response->isSent())
+        _endResponse(client);
+}
+
+/*
+finishing a fully sent Response:
+    - checking if connection should be "keep-alive"
+    - set epoll settings on client_fd to EPOLLIN
+    - detaching request and response from the client, it is idle until its next request
+*/
+void    ServerManager::_endResponse(Client &client)
+{
+    int fd = client._client_fd;
+
+    Logger::log(MAGENTA, INFO, "Response send to client fd[%i] with code[%i]", client._client_fd, client.response->getError());
+
+    // checking if connection should be "keep-alive"
+    if (client.response->checkConnection())
     {
-        Logger::log(MAGENTA, INFO, "Response send to client fd[%i] with code[%i]", client._client_fd, client.response.getError());
-    
-        // checking if connection should be "keep-alive"
-        if (client.response.checkConnection())
+        struct epoll_event event;
+
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, fd, &event))
         {
-            struct epoll_event event;
+            Logger::log(RED, ERROR, "Changing settings associated with fd[%i] in epoll instance failed", _epoll_fd);
+            exit(EXIT_FAILURE);
+        }
+        _detachState(client);
+    }
+    else
+        _closeConnection(fd);
+}
+
+/*
+attaches a request and a response to a client which got data, spare ones are taken first
+*/
+void    ServerManager::_attachState(Client &client)
+{
+    if (_spares.empty())
+    {
+        client.request = new Request();
+        client.response = new Response();
+    }
+    else
+    {
+        client.request = _spares.back().first;
+        client.response = _spares.back().second;
+        _spares.pop_back();
+    }
+    client.request->setSocket(client.socket);
+    client.request->setConfig(_config);
+}
+
+/*
+clears request and response of a client, the client is idle again:
+    - they are kept as spares for the next client with data, up to MAX_SPARE_STATES of them,
+      so the memory follows the connections with a request in flight, not all connections
+    - the response is cleared first, its cgi still uses the configuration the request holds
+*/
+void    ServerManager::_detachState(Client &client)
+{
+    if (client.request == NULL)
+        return ;
+    client.response->clear();
+    client.request->clear();
+    if (_spares.size() < MAX_SPARE_STATES)
+        _spares.push_back(std::make_pair(client.request, client.response));
+    else
+    {
+        delete client.request;
+        delete client.response;
+    }
+    client.request = NULL;
+    client.response = NULL;
+}
+
+/*
+checks what the parser can not check on its own, throws ConfigParser::ConfigError after logging an error:
+    - at least one server block
+    - a cgi_pool only for an extension with a cgi, and only for python interpreters
+*/
+void    ServerManager::_checkConfig(const std::vector<ServerBlock> &server_blocks)
+{
+    if (server_blocks.size() == 0)
+    {
+        Logger::log(RED, ERROR, "Config File: no server block found ( empty file ? )");
+        throw ConfigParser::ConfigError();
+    }
+    for (size_t i = 0; i < server_blocks.size(); i++)
+    {
+        for (std::map<std::string, Location>::const_iterator it = server_blocks[i]._locations.begin(); it != server_blocks[i]._locations.end(); it++)
+        {
+            const std::map<std::string, std::pair<size_t, size_t> > &pools = it->second._cgi_pool;
 
-            event.events = EPOLLIN;
-            event.data.fd = fd;
-            if (epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, fd, &event))
+            for (std::map<std::string, std::pair<size_t, size_t> >::const_iterator pool = pools.begin(); pool != pools.end(); pool++)
             {
-                Logger::log(RED, ERROR, "Changing settings associated with fd[%i] in epoll instance failed", _epoll_fd);
-                exit(EXIT_FAILURE);
+                std::map<std::string, std::string>::const_iterator cgi = it->second._cgi.find(pool->first);
+
+                if (cgi == it->second._cgi.end())
+                {
+                    Logger::log(RED, ERROR, "Config file misconfigured: cgi_pool directive: no cgi for extension %s", pool->first.c_str());
+                    throw ConfigParser::ConfigError();
+                }
+                if (cgi->second.substr(cgi->second.find_last_of('/') + 1).compare(0, 6, "python") != 0)
+                {
+                    Logger::log(RED, ERROR, "Config file misconfigured: cgi_pool directive: only python interpreters can be pooled");
+                    throw ConfigParser::ConfigError();
+                }
             }
-            client.response.clear();
-            client.request.clear();
         }
-        else
-            _closeConnection(fd);
     }
-    else
-        client.response.trimResponse(bytes_send);
+}
+
+/*
+compiles parsed and checked server blocks into the configuration the server runs with:
+    - setting up the queues of the locations with a cgi_max_concurrency, on a reload a location
+      (same listen address, server name and path) with unchanged limits keeps its queue, the cgis
+      running on it still count; otherwise a queue is appended and the old one drains with the
+      cgis of the old configuration
+    - setting up the pools of pre-spawned cgi interpreters, a reload replaces the pool set
+    - assigning sockets to the server blocks
+*/
+void    ServerManager::_compileConfig(std::vector<ServerBlock> &server_blocks)
+{
+    // printing the server setup
+    for (size_t i = 0; i < server_blocks.size(); i++)
+    {
+        std::string server_name = "";
+        if (!server_blocks[i]._server_names.empty())
+            server_name = server_blocks[i]._server_names[0];
+        Logger::log(WHITE, INFO, "Server setup: Name[%s] Host[%s] Port[%i]", server_name.c_str(), server_blocks[i]._ip.c_str(), server_blocks[i]._port);
+    }
+
+    // setting up the queues of the locations with a cgi_max_concurrency, reusing the queue of the same location
+    std::vector<bool>   claimed(_cgi_queues.size(), false);
+
+    for (size_t i = 0; i < server_blocks.size(); i++)
+    {
+        std::ostringstream  server;
+
+        server << server_blocks[i]._ip << ":" << server_blocks[i]._port << " ";
+        if (!server_blocks[i]._server_names.empty())
+            server << server_blocks[i]._server_names[0];
+        for (std::map<std::string, Location>::iterator it = server_blocks[i]._locations.begin(); it != server_blocks[i]._locations.end(); it++)
+        {
+            CgiQueue    queue;
+            std::string location = server.str() + " " + it->first;
+            size_t      id = 0;
+
+            if (it->second._cgi_max_concurrency == 0)
+                continue ;
+            while (id < _cgi_queues.size() && (claimed[id]
+                || _cgi_queues[id]._location != location
+                || _cgi_queues[id]._max_concurrency != it->second._cgi_max_concurrency
+                || _cgi_queues[id]._size != it->second._cgi_queue_size
+                || _cgi_queues[id]._timeout != it->second._cgi_queue_timeout))
+                id++;
+            it->second._cgi_queue_id = id;
+            if (id < _cgi_queues.size())
+            {
+                claimed[id] = true;
+                continue ;
+            }
+            queue._location = location;
+            queue._max_concurrency = it->second._cgi_max_concurrency;
+            queue._size = it->second._cgi_queue_size;
+            queue._timeout = it->second._cgi_queue_timeout;
+            queue._running = 0;
+            _cgi_queues.push_back(queue);
+            claimed.push_back(true);
+        }
+    }
+
+    // setting up the pools of pre-spawned cgi interpreters, the largest limits of a binary count
+    std::map<std::string, std::pair<size_t, size_t> > cgi_pools;
+
+    for (size_t i = 0; i < server_blocks.size(); i++)
+    {
+        for (std::map<std::string, Location>::iterator it = server_blocks[i]._locations.begin(); it != server_blocks[i]._locations.end(); it++)
+        {
+            std::map<std::string, std::pair<size_t, size_t> > &pools = it->second._cgi_pool;
+
+            for (std::map<std::string, std::pair<size_t, size_t> >::iterator pool = pools.begin(); pool != pools.end(); pool++)
+            {
+                std::pair<size_t, size_t> &limits = cgi_pools[it->second._cgi[pool->first]];
+
+                limits.first = std::max(limits.first, pool->second.first);
+                limits.second = std::max(limits.second, pool->second.second);
+            }
+        }
+    }
+    CgiPool::configure(cgi_pools);
+
+    // assigning sockets to server blocks
+    for (size_t i = 0; i < server_blocks.size(); i++)
+    {
+        for (std::map<int, Socket>::iterator it = _socket_map.begin(); it != _socket_map.end(); it++)
+        {
+            if (it->second.getHost() == server_blocks[i]._host && it->second.getPort() == server_blocks[i]._port)
+            {
+                server_blocks[i]._socket = &it->second;
+                break ;
+            }
+        }
+    }
+}
+
+/*
+checks the content of a config file in a child process, it is only parsed and checked
+    - the running configuration is not touched, true is returned if the content is valid
+    - the child shares the state of the server, it leaves with _exit() so nothing of it is cleaned up
+*/
+bool    ServerManager::_validateConfig(const std::string &content)
+{
+    int     status;
+    pid_t   pid = fork();
+
+    if (pid == -1)
+    {
+        Logger::log(RED, ERROR, "Forking for the config file check failed: %s", strerror(errno));
+        return false;
+    }
+    if (pid == 0)
+    {
+        std::vector<ServerBlock>    server_blocks;
+        ConfigParser                parser(server_blocks);
+
+        try
+        {
+            parser.parseContent(content);
+            _checkConfig(server_blocks);
+        }
+        catch(const std::exception& e)
+        {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+    while (waitpid(pid, &status, 0) == -1)
+    {
+        if (errno != EINTR)
+            return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+/*
+reloads the config file (SIGHUP), requests in flight finish on the configuration they started with:
+    - the file is read once, its content is checked in a child process first and then parsed
+      again here, a broken file keeps the running configuration
+    - the listening sockets stay, a file with other listen directives needs a restart
+    - every request which starts after the swap gets the new snapshot, the old one is
+      deleted once its last request is done
+*/
+void    ServerManager::_reloadConfig()
+{
+    std::vector<ServerBlock>        server_blocks;
+    std::map<uint16_t, in_addr_t>   listeners;
+    std::map<uint16_t, in_addr_t>   sockets;
+    std::ifstream                   file(_config_path.c_str());
+    std::stringstream               content;
+
+    Logger::log(WHITE, INFO, "Reloading configuration from %s ...", _config_path.c_str());
+    if (file.fail())
+    {
+        Logger::log(RED, ERROR, "Reloading failed, unable to read %s, keeping configuration generation[%lu]", _config_path.c_str(), _config->getGeneration());
+        return ;
+    }
+    content << file.rdbuf();
+    file.close();
+    if (!_validateConfig(content.str()))
+    {
+        Logger::log(RED, ERROR, "Reloading failed, keeping configuration generation[%lu]", _config->getGeneration());
+        return ;
+    }
+
+    ConfigParser    parser(server_blocks);
+
+    try
+    {
+        parser.parseContent(content.str());
+        _checkConfig(server_blocks);
+    }
+    catch(const std::exception& e)
+    {
+        // the file was valid in the check, something it refers to changed since
+        Logger::log(RED, ERROR, "Reloading failed, keeping configuration generation[%lu]", _config->getGeneration());
+        (new ConfigSnapshot(server_blocks, 0))->release();
+        return ;
+    }
+    for (size_t i = 0; i < server_blocks.size(); i++)
+        listeners.insert(std::pair<uint16_t, in_addr_t>(server_blocks[i]._port, server_blocks[i]._host));
+    for (std::map<int, Socket>::iterator it = _socket_map.begin(); it != _socket_map.end(); it++)
+        sockets.insert(std::pair<uint16_t, in_addr_t>(it->second.getPort(), it->second.getHost()));
+    if (listeners != sockets)
+    {
+        Logger::log(RED, ERROR, "Reloading failed, the listen directives changed (needs a restart)");
+        // the snapshot closes the root fds of the discarded server blocks
+        (new ConfigSnapshot(server_blocks, 0))->release();
+        return ;
+    }
+    _compileConfig(server_blocks);
+
+    ConfigSnapshot  *config = new ConfigSnapshot(server_blocks, _config->getGeneration() + 1);
+
+    _config->release();
+    _config = config;
+    Logger::log(WHITE, INFO, "Reloaded configuration, generation[%lu]", _config->getGeneration());
 }
 
 // ==========   Member functions   =========== //
@@ -254,37 +1142,34 @@ setting up all servers
     - calls parsing of the config file
     - setting up all sockets
     - adding sockets to the _socket_map
-    - assigning sockets to the server blocks
+    - compiling the server blocks into the first snapshot of the configuration
 */
 void    ServerManager::setup(std::string config)
 {
+    std::vector<ServerBlock>    server_blocks;
+
     Logger::log(WHITE, INFO, "Setting up Servers ...");
 
     // parsing the config file 
-    ConfigParser        parser(_server_blocks);
+    ConfigParser        parser(server_blocks);
 
-    parser.parse(config);
-    Logger::log(GREY, DEBUG, "Finished config file parsing");
-    if (_server_blocks.size() == 0)
+    _config_path = config;
+    try
     {
-        Logger::log(RED, ERROR, "Config File: no server block found ( empty file ? )");
-        exit(EXIT_FAILURE);
+        parser.parse(config);
+        _checkConfig(server_blocks);
     }
-
-    // printing the server setup
-    for (size_t i = 0; i < _server_blocks.size(); i++)
+    catch(const std::exception& e)
     {
-        std::string server_name = "";
-        if (!_server_blocks[i]._server_names.empty())
-            server_name = _server_blocks[i]._server_names[0];
-        Logger::log(WHITE, INFO, "Server setup: Name[%s] Host[%s] Port[%i]", server_name.c_str(), _server_blocks[i]._ip.c_str(), _server_blocks[i]._port);
+        exit(EXIT_FAILURE);
     }
+    Logger::log(GREY, DEBUG, "Finished config file parsing");
 
     // find all needed sockets
     std::map<uint16_t, in_addr_t> map;
 
-    for (size_t i = 0; i < _server_blocks.size(); i++)
-        map.insert(std::pair<uint16_t, in_addr_t>(_server_blocks[i]._port, _server_blocks[i]._host));
+    for (size_t i = 0; i < server_blocks.size(); i++)
+        map.insert(std::pair<uint16_t, in_addr_t>(server_blocks[i]._port, server_blocks[i]._host));
 
     // set host and port for all needed sockets
     std::vector<Socket> sockets;
@@ -311,37 +1196,40 @@ void    ServerManager::setup(std::string config)
         Logger::log(GREY, DEBUG, "Socket setup: Host[%s] Port[%i]", inAddrToIpString(htonl(sockets[i].getHost())).c_str(), sockets[i].getPort());
     }
 
-    // assigning sockets to server blocks
-    for (size_t i = 0; i < _server_blocks.size(); i++)
-    {
-        for (std::map<int, Socket>::iterator it = _socket_map.begin(); it != _socket_map.end(); it++)
-        {
-            if (it->second.getHost() == _server_blocks[i]._host && it->second.getPort() == _server_blocks[i]._port)
-            {
-                _server_blocks[i]._socket = &it->second;
-                break ;
-            }
-        }
-    }
     Logger::log(GREY, DEBUG, "Setting up Sockets finished");
+    _compileConfig(server_blocks);
+    _config = new ConfigSnapshot(server_blocks, 1);
 }
 
 /*
 booting the servers:
+    - raising the limit of open files to its hard limit, an idle connection costs little more than its fd
     - creating the epoll instance
     - adding server_fds to the epoll instance
     - start listening on the server sockets
 main server loop:
-    - waiting for events on the fds of the epoll instance
+    - reloading the configuration after a SIGHUP
+    - waiting for events on the fds of the epoll instance (at most EPOLL_WAIT_TIMEOUT ms)
     - handling the epoll event list
     - checking for timeouts
+    - refilling the pools of pre-spawned cgi interpreters while no cgi is running
 */
 void    ServerManager::boot()
 {
     Logger::log(WHITE, INFO, "Booting Servers ...");
 
+    // raises the limit of open files, so up to MAX_CONNECTIONS can be open
+    struct rlimit   limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+            Logger::log(YELLOW, INFO, "Raising the limit of open files failed: %s", strerror(errno));
+    }
+
     // creates epoll instance
-    _epoll_fd = epoll_create(1);
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
     if (_epoll_fd == -1)
     {
         Logger::log(RED, ERROR, "Creating epoll instace failed");
@@ -370,16 +1258,20 @@ void    ServerManager::boot()
 
     while (true)
     {
+        if (_reload_requested)
+        {
+            _reload_requested = 0;
+            _reloadConfig();
+        }
         // wating for events on the epoll instance
-        int num_events = epoll_wait(_epoll_fd, event_list, MAX_EPOLL_EVENTS, -1);
+        int num_events = epoll_wait(_epoll_fd, event_list, MAX_EPOLL_EVENTS, EPOLL_WAIT_TIMEOUT);
         if (num_events == -1)
         {
-            Logger::log(RED, ERROR, "Waiting for event on the epoll instance failed: %s", strerror(errno));
-            // Interrupted by a signal; retry
+            // Interrupted by a signal (SIGHUP for a reload); retry
             if (errno == EINTR)
                 continue ;
-            else
-                exit(EXIT_FAILURE);
+            Logger::log(RED, ERROR, "Waiting for event on the epoll instance failed: %s", strerror(errno));
+            exit(EXIT_FAILURE);
         }
         // handling of the epoll event list
         for (int i = 0; i < num_events; i++)
@@ -388,13 +1280,34 @@ void    ServerManager::boot()
 
             if (_socket_map.count(fd))
                 _acceptNewConnection(fd);
+            else if (_cgi_fd_map.count(fd))
+                _handleCgiEvent(fd);
             else if (_client_map.count(fd) && event_list[i].events & EPOLLIN)
                 _readRequest(_client_map[fd]);
             else if (_client_map.count(fd) && event_list[i].events & EPOLLOUT)
                 _sendResponse(_client_map[fd]);
+            else if (_client_map.count(fd))
+            {
+                Logger::log(CYAN, INFO, "Client fd[%i] closed connection", fd);
+                _closeConnection(fd);
+            }
             else
                 close(fd);
         }
         _checkTimeout();
+        // new interpreters would compete with running scripts for the cpu, so the pools get
+        // refilled once no cgi is running (or nothing happened for EPOLL_WAIT_TIMEOUT ms)
+        if (_cgi_fd_map.empty() || num_events == 0)
+            CgiPool::maintain();
     }
 }
+
+// =======   Static member functions   ======= //
+/*
+signal handler of SIGHUP, the configuration is reloaded by the main server loop
+*/
+void    ServerManager::requestReload(int signal)
+{
+    (void)signal;
+    _reload_requested = 1;
+}
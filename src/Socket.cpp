@@ -80,8 +80,8 @@ setting up an non blocking TCP socket for listening for new connections:
 */
 int    Socket::setup()
 {
-    // creating the socket
-    _fd = socket(AF_INET, SOCK_STREAM, 0);
+    // creating the socket (not inherited by cgi processes)
+    _fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (_fd < 0)
         return -1;
 
@@ -119,6 +119,7 @@ int    Socket::startListening()
 /*
 accepting new incomming connection on the socket
     - setting the new socket for the connection in non blocking mode
+    - the new socket does not get inherited by cgi processes
     - on success, the fd of the new socket is returned
     - on error, -1 is returned, and errno is set to indicate the error
 */
@@ -127,9 +128,7 @@ int    Socket::acceptConnection()
     int new_socket;
     int addrlen = sizeof(_addr);
 
-    if ((new_socket = accept(_fd, (struct sockaddr *)&_addr, (socklen_t*)&addrlen)) < 0)
-        return -1;
-    if (setNonBlocking(_fd) < 0)
+    if ((new_socket = accept4(_fd, (struct sockaddr *)&_addr, (socklen_t*)&addrlen, SOCK_CLOEXEC | SOCK_NONBLOCK)) < 0)
         return -1;
     return new_socket;
 }
@@ -24,6 +24,11 @@ int main(int argc, char **argv)
         Logger::log(RED, ERROR, "Failed to ignore SIGPIPE");
         return (EXIT_FAILURE);
     }
+    if (signal(SIGHUP, ServerManager::requestReload) == SIG_ERR)
+    {
+        Logger::log(RED, ERROR, "Failed to set up SIGHUP for reloading the configuration");
+        return (EXIT_FAILURE);
+    }
     ServerManager   master;
 
     master.setup(config);
@@ -34,9 +39,7 @@ int main(int argc, char **argv)
 
 // RESPONSE:
 // - POST with an script.py what is not there -> should upload or should say not found ???
-// - multiple files in post request
 
 // CGI:
 // - set REMOTE_ADDR & REMOTE_HOST & REMOTE_IDENT & REMOTE_USER
 // - make an cgi script to test POST request with cgi
-// - check for infinite loop in cgi -> kill cgi after while
@@ -0,0 +1,56 @@
+#!/bin/bash
+# sends chunked uploads with oversized chunk sizes to a webserv started on conf/default.conf
+#   usage: tests/chunk_size.sh (from the repository root, after make)
+
+HOST=127.0.0.1
+PORT=8080
+FAILED=0
+
+# sends one chunked POST to /uploads/<name> and prints the status code of the answer
+send_chunked()
+{
+    local name=$1
+    local body=$2
+    local line
+
+    exec 3<>/dev/tcp/$HOST/$PORT || return 1
+    printf 'POST /uploads/%s HTTP/1.1\r\nHost: %s\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n%b' "$name" "$HOST" "$body" >&3
+    read -r -t 5 line <&3
+    exec 3<&-
+    echo "$line" | cut -d' ' -f2
+}
+
+# expects the status code for a chunked body, the upload must only exist after a 201
+check()
+{
+    local name=$1
+    local expected=$2
+    local body=$3
+    local status
+
+    status=$(send_chunked "$name" "$body")
+    if [ "$status" != "$expected" ]; then
+        echo "FAIL $name: got ${status:-no answer}, expected $expected"
+        FAILED=1
+    elif [ "$expected" != 201 ] && [ -e "docs/uploads/$name" ]; then
+        echo "FAIL $name: $expected but the upload was stored"
+        FAILED=1
+    else
+        echo "ok   $name: $status"
+    fi
+    rm -f "docs/uploads/$name"
+}
+
+./webserv conf/default.conf > /dev/null 2>&1 &
+SERVER=$!
+sleep 1
+
+check chunk_valid.txt     201 '5\r\nhello\r\n0\r\n\r\n'
+# 17 hex digits wrap around to 5 in a 64 bit size_t, the refused requests end after the size line
+# (the server closes right after the answer, unread data would reset the connection)
+check chunk_wrap.txt      400 '10000000000000005\r\n'
+check chunk_digits.txt    400 'fffffffffffffffffffff\r\n'
+
+kill $SERVER
+wait $SERVER 2> /dev/null
+exit $FAILED